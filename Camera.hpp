@@ -14,6 +14,8 @@
 
 #include <spdlog/spdlog.h>
 
+#include <Metrics.hpp>
+#include <Trace.hpp>
 #include <Space.hpp>
 
 namespace SPRITS
@@ -51,8 +53,14 @@ namespace SPRITS
 			return signals_[event].connect(std::forward<Observer>(observer), position);
 		}
 		
-		void notify(const NewFrameEvent& event, const cv::Mat& frame)
+		// Sensor is the time the driver handed over the frame, every stage latency is measured from it.
+		void notify(const NewFrameEvent& event, const cv::Mat& frame, MotionClock::time_point sensor = MotionClock::now())
 		{
+			TraceScope scope((event == NewFrameEvent::COLOR) ? "Camera::notify color" : "Camera::notify depth");
+			FrameTrace& trace = Metrics::trace();
+			trace = FrameTrace { Metrics::sequence(), sensor, MotionClock::now(), false };
+			Metrics::stage(CAPTURE).record(trace.notified - sensor);
+			Metrics::stream(static_cast<std::size_t>(event)).tick(sensor);
 			if (event == NewFrameEvent::COLOR)
 			{
 				if (crop_ || debug_)
@@ -60,6 +68,8 @@ namespace SPRITS
 			}
 			if (!crop_)
 				signals_[event](event, frame);
+			if (scope.begin())
+				Trace::frame(scope.begin(), Trace::now());
 		}
 		
 		virtual ~Camera()
@@ -0,0 +1,245 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include <Motion.hpp>
+
+#define HISTOGRAM_SUB_BITS 4 // Each power of two is split in 2^HISTOGRAM_SUB_BITS buckets, about 6% relative error.
+#define HISTOGRAM_MAX_BITS 40 // Microsecond latencies above 2^HISTOGRAM_MAX_BITS land in the last bucket.
+
+namespace SPRITS
+{
+	// Every stage measures the latency from the sensor timestamp of a frame to the end of that stage:
+	// the camera notifying its observers, the trackers committing the Space, each publisher committing
+	// the frame and the frame reaching a socket write.
+	enum Stage { CAPTURE, TRACK, PUBLISH, SEND, STAGES };
+
+	// Log-linear histogram of microsecond values in the spirit of HdrHistogram: values below
+	// 2^(HISTOGRAM_SUB_BITS + 1) are exact, larger ones share a bucket with neighbours within the
+	// relative error. Recording is a few relaxed atomic operations and never locks.
+	class LatencyHistogram
+	{
+	public:
+		static const std::size_t LINEAR = std::size_t(2) << HISTOGRAM_SUB_BITS;
+		static const std::size_t SUB = std::size_t(1) << HISTOGRAM_SUB_BITS;
+		static const std::size_t BUCKETS = LINEAR + (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS - 1) * SUB;
+	private:
+		std::atomic<uint64_t> buckets_[BUCKETS];
+		std::atomic<uint64_t> count_, sum_, max_;
+	public:
+		LatencyHistogram() : count_(0), sum_(0), max_(0)
+		{
+			for (auto& bucket : buckets_)
+				bucket.store(0, std::memory_order_relaxed);
+		}
+
+		static std::size_t bucket(uint64_t value)
+		{
+			if (value < LINEAR)
+				return value;
+			int msb = 63 - __builtin_clzll(value);
+			std::size_t index = LINEAR + (msb - HISTOGRAM_SUB_BITS - 1) * SUB + ((value >> (msb - HISTOGRAM_SUB_BITS)) - SUB);
+			return (index < BUCKETS) ? index : BUCKETS - 1;
+		}
+
+		// Largest value counted in the given bucket.
+		static uint64_t highest(std::size_t bucket)
+		{
+			if (bucket < LINEAR)
+				return bucket;
+			std::size_t octave = (bucket - LINEAR) / SUB, sub = (bucket - LINEAR) % SUB;
+			int shift = octave + 1;
+			return ((SUB + sub + 1) << shift) - 1;
+		}
+
+		void record(uint64_t micros)
+		{
+			buckets_[bucket(micros)].fetch_add(1, std::memory_order_relaxed);
+			count_.fetch_add(1, std::memory_order_relaxed);
+			sum_.fetch_add(micros, std::memory_order_relaxed);
+			uint64_t max = max_.load(std::memory_order_relaxed);
+			while ((micros > max) && !max_.compare_exchange_weak(max, micros, std::memory_order_relaxed)) { }
+		}
+
+		void record(MotionClock::duration latency)
+		{
+			long long micros = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+			record(static_cast<uint64_t>((micros > 0) ? micros : 0));
+		}
+
+		uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+		uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+		uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+		uint64_t at(std::size_t bucket) const { return buckets_[bucket].load(std::memory_order_relaxed); }
+
+		// Upper bound of the bucket holding the given quantile, 0 while empty.
+		uint64_t percentile(double quantile) const
+		{
+			uint64_t total = count();
+			if (total == 0)
+				return 0;
+			uint64_t rank = static_cast<uint64_t>(quantile * total), seen = 0;
+			for (std::size_t i = 0; i < BUCKETS; ++i)
+			{
+				seen += at(i);
+				if (seen > rank)
+					return std::min(highest(i), max());
+			}
+			return max();
+		}
+	};
+
+	// Frame counters of a camera stream, only ever written by the thread delivering its frames.
+	struct StreamCounters
+	{
+		std::atomic<uint64_t> frames, dropped;
+		std::atomic<int64_t> last, interval;
+
+		StreamCounters() : frames(0), dropped(0), last(0), interval(0) { }
+
+		void tick(MotionClock::time_point now)
+		{
+			int64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+			int64_t previous = last.exchange(time, std::memory_order_relaxed);
+			if (previous > 0)
+			{
+				int64_t average = interval.load(std::memory_order_relaxed);
+				interval.store(average ? average + (time - previous - average) / 8 : time - previous, std::memory_order_relaxed);
+			}
+			frames.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Frames per second over roughly the last eight frames, 0 once the stream stalls.
+		double fps(MotionClock::time_point now) const
+		{
+			int64_t average = interval.load(std::memory_order_relaxed), time = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+			if ((average <= 0) || (time - last.load(std::memory_order_relaxed) > std::max<int64_t>(4 * average, 1000000000)))
+				return 0;
+			return 1e9 / average;
+		}
+	};
+
+	enum Gauge { ASYNC_QUEUE, GAUGES };
+
+	// Identity of the frame being processed on the current thread, set by Camera::notify and carried
+	// across threads by AsyncSpace.
+	struct FrameTrace
+	{
+		uint64_t sequence;
+		MotionClock::time_point sensor, notified;
+		bool tracked;
+	};
+
+	class Metrics
+	{
+	public:
+		static LatencyHistogram& stage(Stage stage)
+		{
+			static LatencyHistogram histograms[STAGES];
+			return histograms[stage];
+		}
+
+		static const char* name(Stage stage)
+		{
+			static const char* names[] = { "capture", "track", "publish", "send" };
+			return names[stage];
+		}
+
+		// Indexed by NewFrameEvent.
+		static StreamCounters& stream(std::size_t stream)
+		{
+			static StreamCounters streams[2];
+			return streams[stream];
+		}
+
+		static std::atomic<int64_t>& gauge(Gauge gauge)
+		{
+			static std::atomic<int64_t> gauges[GAUGES] = {};
+			return gauges[gauge];
+		}
+
+		static FrameTrace& trace()
+		{
+			static thread_local FrameTrace trace = FrameTrace();
+			return trace;
+		}
+
+		static uint64_t sequence()
+		{
+			static std::atomic<uint64_t> sequence(0);
+			return sequence.fetch_add(1, std::memory_order_relaxed) + 1;
+		}
+
+		// Records the latency of the current frame up to the end of a stage.
+		static void reached(Stage stage)
+		{
+			const FrameTrace& current = trace();
+			if (current.sequence > 0)
+				Metrics::stage(stage).record(MotionClock::now() - current.sensor);
+		}
+
+		// One line of p50/p99 milliseconds per stage, e.g. for periodic logging.
+		static std::string summary()
+		{
+			std::string out;
+			char buffer[96];
+			for (int i = 0; i < STAGES; ++i)
+			{
+				const LatencyHistogram& histogram = stage(static_cast<Stage>(i));
+				out.append(buffer, std::snprintf(buffer, sizeof(buffer), "%s%s %.1f/%.1f", i ? ", " : "", name(static_cast<Stage>(i)), histogram.percentile(0.5) / 1000.0, histogram.percentile(0.99) / 1000.0));
+			}
+			return out;
+		}
+
+		// Process wide metrics in the Prometheus text exposition format, latencies in seconds.
+		static std::string exposition()
+		{
+			static const uint64_t bounds[] = { 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000 };
+			static const char* streams[] = { "color", "depth" };
+			std::string out;
+			char buffer[160];
+			MotionClock::time_point now = MotionClock::now();
+			out += "# HELP sprits_frames_total Frames delivered by the camera.\n# TYPE sprits_frames_total counter\n";
+			for (std::size_t i = 0; i < 2; ++i)
+				out.append(buffer, std::snprintf(buffer, sizeof(buffer), "sprits_frames_total{stream=\"%s\"} %llu\n", streams[i], (unsigned long long) stream(i).frames.load(std::memory_order_relaxed)));
+			out += "# HELP sprits_frames_dropped_total Frames lost by the camera before delivery.\n# TYPE sprits_frames_dropped_total counter\n";
+			for (std::size_t i = 0; i < 2; ++i)
+				out.append(buffer, std::snprintf(buffer, sizeof(buffer), "sprits_frames_dropped_total{stream=\"%s\"} %llu\n", streams[i], (unsigned long long) stream(i).dropped.load(std::memory_order_relaxed)));
+			out += "# HELP sprits_fps Recent frame rate of the camera.\n# TYPE sprits_fps gauge\n";
+			for (std::size_t i = 0; i < 2; ++i)
+				out.append(buffer, std::snprintf(buffer, sizeof(buffer), "sprits_fps{stream=\"%s\"} %.2f\n", streams[i], stream(i).fps(now)));
+			out += "# HELP sprits_latency_seconds Latency from the sensor timestamp to the end of each stage.\n# TYPE sprits_latency_seconds histogram\n";
+			for (int i = 0; i < STAGES; ++i)
+			{
+				const LatencyHistogram& histogram = stage(static_cast<Stage>(i));
+				uint64_t cumulative = 0;
+				std::size_t bucket = 0;
+				for (uint64_t bound : bounds)
+				{
+					for (; (bucket < LatencyHistogram::BUCKETS) && (LatencyHistogram::highest(bucket) <= bound); ++bucket)
+						cumulative += histogram.at(bucket);
+					out.append(buffer, std::snprintf(buffer, sizeof(buffer), "sprits_latency_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n", name(static_cast<Stage>(i)), bound / 1e6, (unsigned long long) cumulative));
+				}
+				for (; bucket < LatencyHistogram::BUCKETS; ++bucket)
+					cumulative += histogram.at(bucket);
+				out.append(buffer, std::snprintf(buffer, sizeof(buffer), "sprits_latency_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n", name(static_cast<Stage>(i)), (unsigned long long) cumulative));
+				out.append(buffer, std::snprintf(buffer, sizeof(buffer), "sprits_latency_seconds_sum{stage=\"%s\"} %.6f\n", name(static_cast<Stage>(i)), histogram.sum() / 1e6));
+				out.append(buffer, std::snprintf(buffer, sizeof(buffer), "sprits_latency_seconds_count{stage=\"%s\"} %llu\n", name(static_cast<Stage>(i)), (unsigned long long) cumulative));
+			}
+			out += "# HELP sprits_async_queue_depth Events waiting for the publishing thread.\n# TYPE sprits_async_queue_depth gauge\n";
+			out.append(buffer, std::snprintf(buffer, sizeof(buffer), "sprits_async_queue_depth %lld\n", (long long) gauge(ASYNC_QUEUE).load(std::memory_order_relaxed)));
+			return out;
+		}
+	};
+}
+
+#endif
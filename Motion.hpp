@@ -0,0 +1,123 @@
+#ifndef MOTION_HPP
+#define MOTION_HPP
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <tuple>
+
+namespace SPRITS
+{
+	typedef std::chrono::steady_clock MotionClock;
+
+	template<typename T> struct MotionTraits;
+
+	template<> struct MotionTraits<std::tuple<double, double, double>>
+	{
+		typedef std::tuple<double, double, double> value_type;
+
+		static double wrap(double angle)
+		{
+			return std::remainder(angle, 2 * M_PI);
+		}
+
+		// Rate of change between two positions, the angle taking the shortest way around.
+		static value_type rate(const value_type& from, const value_type& to, double dt)
+		{
+			return std::make_tuple((std::get<0>(to) - std::get<0>(from)) / dt, (std::get<1>(to) - std::get<1>(from)) / dt, wrap(std::get<2>(to) - std::get<2>(from)) / dt);
+		}
+
+		// Rate of change between two velocities, which are not angles and must not be wrapped.
+		static value_type derivative(const value_type& from, const value_type& to, double dt)
+		{
+			return std::make_tuple((std::get<0>(to) - std::get<0>(from)) / dt, (std::get<1>(to) - std::get<1>(from)) / dt, (std::get<2>(to) - std::get<2>(from)) / dt);
+		}
+
+		static value_type interpolate(const value_type& from, const value_type& to, double w)
+		{
+			return std::make_tuple(std::get<0>(from) + w * (std::get<0>(to) - std::get<0>(from)), std::get<1>(from) + w * (std::get<1>(to) - std::get<1>(from)), wrap(std::get<2>(from) + w * wrap(std::get<2>(to) - std::get<2>(from))));
+		}
+
+		static value_type extrapolate(const value_type& position, const value_type& velocity, const value_type& acceleration, double dt)
+		{
+			return std::make_tuple(std::get<0>(position) + dt * (std::get<0>(velocity) + 0.5 * dt * std::get<0>(acceleration)), std::get<1>(position) + dt * (std::get<1>(velocity) + 0.5 * dt * std::get<1>(acceleration)), wrap(std::get<2>(position) + dt * (std::get<2>(velocity) + 0.5 * dt * std::get<2>(acceleration))));
+		}
+	};
+
+	template<typename T> struct MotionSample
+	{
+		MotionClock::time_point time;
+		T position, velocity, acceleration;
+	};
+
+	// Fixed-size ring of the most recent samples of one element, newest first.
+	template<typename T, std::size_t N = 16> class MotionHistory
+	{
+	private:
+		std::array<MotionSample<T>, N> samples_;
+		std::size_t head_, size_;
+
+		static double seconds(MotionClock::duration d)
+		{
+			return std::chrono::duration_cast<std::chrono::duration<double>>(d).count();
+		}
+	public:
+		MotionHistory() : head_(0), size_(0) { }
+
+		std::size_t size() const { return size_; }
+
+		bool empty() const { return size_ == 0; }
+
+		void clear() { head_ = size_ = 0; }
+
+		const MotionSample<T>& operator[](std::size_t age) const
+		{
+			return samples_[(head_ + N - age) % N];
+		}
+
+		void push(MotionClock::time_point time, const T& position)
+		{
+			MotionSample<T> sample;
+			sample.time = time;
+			sample.position = position;
+			sample.velocity = sample.acceleration = T();
+			if (size_ > 0)
+			{
+				const MotionSample<T>& last = (*this)[0];
+				double dt = seconds(time - last.time);
+				sample.velocity = (dt > 0) ? MotionTraits<T>::rate(last.position, position, dt) : last.velocity;
+				if (size_ > 1)
+					sample.acceleration = (dt > 0) ? MotionTraits<T>::derivative(last.velocity, sample.velocity, dt) : last.acceleration;
+				head_ = (head_ + 1) % N;
+			}
+			samples_[head_] = sample;
+			if (size_ < N)
+				++size_;
+		}
+
+		T positionAt(MotionClock::time_point time) const
+		{
+			if (size_ == 0)
+				return T();
+			const MotionSample<T>& newest = (*this)[0];
+			if (time >= newest.time)
+				return MotionTraits<T>::extrapolate(newest.position, newest.velocity, newest.acceleration, seconds(time - newest.time));
+			if (time <= (*this)[size_ - 1].time)
+				return (*this)[size_ - 1].position;
+			std::size_t lo = 0, hi = size_ - 1;
+			while (hi - lo > 1)
+			{
+				std::size_t mid = (lo + hi) / 2;
+				if ((*this)[mid].time > time)
+					lo = mid;
+				else
+					hi = mid;
+			}
+			const MotionSample<T>& after = (*this)[lo];
+			const MotionSample<T>& before = (*this)[hi];
+			return MotionTraits<T>::interpolate(before.position, after.position, seconds(time - before.time) / seconds(after.time - before.time));
+		}
+	};
+}
+
+#endif
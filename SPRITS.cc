@@ -12,18 +12,27 @@
 
 #include <Camera.hpp>
 #include <Space.hpp>
+#include <Trace.hpp>
 
 #include <cameras/OpenNI.cc>
 #include <cameras/VideoStream.cc>
+#include <cameras/Synthetic.cc>
 #include <trackers/Debug.cc>
 #include <trackers/ChiliTracker.cc>
 #include <trackers/FingerTracker.cc>
+#include <trackers/TUIOTracker.cc>
 #include <spaces/Plane.cc>
+#include <spaces/Predictor.cc>
+#include <spaces/AsyncSpace.cc>
 #include <publishers/WebSocket.cc>
 #include <publishers/TUIO.cc>
+#include <publishers/SharedMemory.cc>
+#include <publishers/FrameStream.cc>
 
 using namespace SPRITS;
 
+#define LOG_QUEUE_SIZE 8192 // Messages buffered for the logging thread, beyond which new ones are dropped.
+
 static bool stop = false;
 
 static const char USAGE[] =
@@ -31,14 +40,26 @@ R"(Simple Pluggable Range Imaging Tracking Server.
 
     Usage:
       SPRITS [options]
-      SPRITS [options] (OpenNI|VideoStream)
+      SPRITS [options] (OpenNI|VideoStream|Synthetic)
 
     Options:
       --help               Show this screen.
+      --beta=<beta>        Smoothing speed coefficient [default: 10].
       --crop               Crop camera image.
       --debug              Enable debug window.
+      --deflate=<bytes>    Offer permessage-deflate, compressing WebSocket messages above <bytes>.
+      --frames=<port>      Stream downscaled color and depth frames to WebSocket viewers on <port>.
+      --io-threads=<n>     WebSocket server I/O threads [default: 1].
+      --min-cutoff=<hz>    Smoothing cutoff frequency at rest, 0 to disable [default: 1].
+      --predict=<ms>       Extrapolate positions by the measured sensor to send latency plus <ms>.
       --record             Enable camera recording.
+      --scene=<scene>      Synthetic camera scene as <width>x<height>@<fps>,<tags>,<hands> [default: 1280x720@30,20,1].
+      --shm=<name>         Enable shared-memory publisher on <name>, e.g. /sprits, read with publishers/SharedMemory.hpp.
+      --trace=<ms>         Record pipeline stages, written as Chrome trace JSON on SIGUSR1 or after a frame slower than <ms>, 0 for SIGUSR1 only.
       --tuio               Enable TUIO publisher.
+      --tuio-extrapolate   Send TUIO positions extrapolated from their motion history to the time they are sent.
+      --tuio-senders=<list>  TUIO transports, any of udp:<host>:<port>, tcp:[<host>:]<port> and ws:<port> [default: udp:localhost:3333,ws:8080].
+      --tuio-sources=<list>  Merge objects from other TUIO servers, ;-separated udp:<port> or tcp:[<host>:]<port>, each optionally followed by @a,b,c,d,e,f mapping (x, y) to (ax+by+c, dx+ey+f).
       --verbose            Enable verbose logging.
       --websocket=<port>   Enable Websocket publisher [default port: 9002].
       --version            Show version.
@@ -46,32 +67,58 @@ R"(Simple Pluggable Range Imaging Tracking Server.
 
 int main(int argc, char **argv)
 {
+	// Per-element debug messages use SPDLOG_DEBUG and only exist in builds defining SPDLOG_DEBUG_ON.
+	spdlog::set_async_mode(LOG_QUEUE_SIZE, spdlog::async_overflow_policy::discard_log_msg);
 	auto console = spdlog::stdout_logger_mt("console", true);
 	try
 	{
 		std::map<std::string, docopt::value> args = docopt::docopt(USAGE, { argv + 1, argv + argc }, true, "SPRITS 1.0");
 		console->set_level(args["--verbose"].asBool()?spdlog::level::debug:spdlog::level::info);
 		signal(SIGINT, [](int nSig) { stop = true; });
-		Camera* cam = args["OpenNI"].asBool()?(Camera*)new OpenNI(args["--crop"].asBool(), args["--debug"].asBool()):(Camera*)new VideoStream(args["--crop"].asBool(), args["--debug"].asBool());
-		Space<std::tuple<double, double, double>>* spc = new Plane();
+		if (args["--trace"])
+		{
+			Trace::enable(boost::lexical_cast<double>(args["--trace"].asString()));
+			signal(SIGUSR1, [](int nSig) { Trace::request(); });
+		}
+		Camera* cam = args["OpenNI"].asBool()?(Camera*)new OpenNI(args["--crop"].asBool(), args["--debug"].asBool()):args["Synthetic"].asBool()?(Camera*)new Synthetic(args["--scene"].asString(), args["--crop"].asBool(), args["--debug"].asBool()):(Camera*)new VideoStream(args["--crop"].asBool(), args["--debug"].asBool());
+		Space<std::tuple<double, double, double>>* spc = new Plane(boost::lexical_cast<double>(args["--min-cutoff"].asString()), boost::lexical_cast<double>(args["--beta"].asString()));
+		if (args["--predict"])
+			spc = new Predictor(spc, boost::lexical_cast<double>(args["--predict"].asString()) / 1000);
+		spc = new AsyncSpace(spc);
 		CameraObserver<std::tuple<double, double, double>>* fpsobs = new ChiliTracker(new Debug3DTracker(cam, spc, args["--record"].asBool(), NewFrameEvent::COLOR));
+		if (args["--tuio-sources"])
+			fpsobs = new TUIOTracker(fpsobs, args["--tuio-sources"].asString());
 		std::list<SpaceObserver<std::tuple<double, double, double>>*> publishers;
 		if (args["--tuio"].asBool())
-			publishers.push_back(new TUIOPublisher(spc));
-		if ((args["--websocket"].isBool()) && (args["--websocket"].asBool()))
-			publishers.push_back(new WebSocketPublisher(spc));
+			publishers.push_back(new TUIOPublisher(spc, args["--tuio-senders"].asString(), args["--tuio-extrapolate"].asBool()));
+		if (args["--shm"])
+			publishers.push_back(new SharedMemoryPublisher(spc, args["--shm"].asString()));
+		int port = ((args["--websocket"].isBool()) && (args["--websocket"].asBool()))?9002:boost::lexical_cast<int>(args["--websocket"].asString());
+		if (args["--deflate"])
+			publishers.push_back(new DeflateWebSocketPublisher(spc, port, boost::lexical_cast<std::size_t>(args["--io-threads"].asString()), boost::lexical_cast<std::size_t>(args["--deflate"].asString())));
 		else
-			publishers.push_back(new WebSocketPublisher(spc, boost::lexical_cast<int>(args["--websocket"].asString())));
+			publishers.push_back(new WebSocketPublisher(spc, port, boost::lexical_cast<std::size_t>(args["--io-threads"].asString())));
+		CameraObserver<std::tuple<double, double, double>>* frames = args["--frames"] ? new FrameStreamPublisher(cam, spc, boost::lexical_cast<int>(args["--frames"].asString())) : nullptr;
 		while (!stop)
+		{
 			cam->update();
-		for (auto const& pub : publishers)
-			delete pub;
+			std::string trace = Trace::poll();
+			if (!trace.empty())
+				console->info("Trace written to {}.", trace);
+		}
+		delete frames;
 		delete fpsobs;
 		delete cam;
+		delete spc;
+		for (auto const& pub : publishers)
+			delete pub;
 	} catch (std::exception& e)
 	{
-		spdlog::get("console")->critical("ERROR: {}", e.what());
+		console->critical("ERROR: {}", e.what());
 	}
+	// The async queue is only drained when the last reference to the logger goes away.
+	console->flush();
+	console.reset();
 	spdlog::drop_all();
-	exit(0);
+	return 0;
 }
@@ -1,13 +1,23 @@
 #ifndef SPACE_HPP
 #define SPACE_HPP
 
+#include <atomic>
 #include <functional>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 
 #include <boost/bind.hpp>
 
+#include <Metrics.hpp>
+#include <Motion.hpp>
+#include <Trace.hpp>
+
+#define FINGER_ID_OFFSET 1024 // Fingertips are published with ids above the chilitags range.
+#define REMOTE_ID_OFFSET 2048 // Objects ingested from other TUIO servers are published with ids above the fingertips range.
+
 namespace SPRITS
 {
 	enum ElementEvent_type { ADD, REMOVE, UPDATE };
@@ -29,27 +39,105 @@ namespace SPRITS
 	{
 	private:
 		boost::signals2::signal<void(const ElementEvent&, int)> signal_;
+		boost::signals2::signal<void()> frameSignal_;
+		std::atomic<bool> recording_;
+		std::mutex historyMutex_;
+		std::unordered_map<int, MotionHistory<T>> history_;
+	protected:
+		// Written by the threads committing the Space, read by its observers, hence historyMutex_.
+		void record(int id, const T& point, MotionClock::time_point time = MotionClock::now())
+		{
+			if (!recording_.load(std::memory_order_relaxed))
+				return;
+			std::lock_guard<std::mutex> lock(historyMutex_);
+			history_[id].push(time, point);
+		}
+		
+		void forget(int id)
+		{
+			if (!recording_.load(std::memory_order_relaxed))
+				return;
+			std::lock_guard<std::mutex> lock(historyMutex_);
+			auto it = history_.find(id);
+			if (it != history_.end())
+				it->second.clear();
+		}
 	public:
+		Space() : recording_(false) { }
+		
 		template <typename Observer>
 		boost::signals2::connection subscribe(Observer&& observer)
 		{
 			return signal_.connect(std::forward<Observer>(observer));
 		}
 		
+		template <typename Observer>
+		boost::signals2::connection subscribeFrame(Observer&& observer)
+		{
+			return frameSignal_.connect(std::forward<Observer>(observer));
+		}
+		
 		virtual T getElement(int id) = 0;
 		
 		virtual void setElement(int id) = 0;
 		
 		virtual void setElement(int id, T point) = 0;
 		
+		virtual void commit() { }
+		
+		// Keeps the motion history of elements for the observers of this Space. Spaces answering getElement
+		// from their component forward it there, so a single Space records whatever the decoration.
+		virtual void recordHistory()
+		{
+			recording_.store(true, std::memory_order_relaxed);
+		}
+		
+		// Newest sample of an element with its velocity and acceleration, false without history.
+		virtual bool getMotion(int id, MotionSample<T>& sample)
+		{
+			std::lock_guard<std::mutex> lock(historyMutex_);
+			auto it = history_.find(id);
+			if ((it == history_.end()) || it->second.empty())
+				return false;
+			sample = it->second[0];
+			return true;
+		}
+		
+		// Position interpolated, or extrapolated past the newest sample, at the given time.
+		virtual T getElementAt(int id, MotionClock::time_point time)
+		{
+			{
+				std::lock_guard<std::mutex> lock(historyMutex_);
+				auto it = history_.find(id);
+				if ((it != history_.end()) && !it->second.empty())
+					return it->second.positionAt(time);
+			}
+			return getElement(id);
+		}
+		
 		void notify(const ElementEvent& event, int id)
 		{
+			TRACE_SCOPE("Space::notify");
 			signal_(event, id);
 		}
 		
+		// The first Space committing a traced frame closes its tracking stage, decorating Spaces inherit it.
+		void notifyFrame()
+		{
+			TRACE_SCOPE("Space::notifyFrame");
+			FrameTrace& trace = Metrics::trace();
+			if ((trace.sequence > 0) && !trace.tracked)
+			{
+				trace.tracked = true;
+				Metrics::reached(TRACK);
+			}
+			frameSignal_();
+		}
+		
 		virtual ~Space()
 		{
 			signal_.disconnect_all_slots();
+			frameSignal_.disconnect_all_slots();
 		}
 	};
 	
@@ -57,16 +145,25 @@ namespace SPRITS
 	{
 	protected:
 		Space<T>* spc_;
-		boost::signals2::connection con_;
+		boost::signals2::connection con_, frameCon_;
+	private:
+		void frame()
+		{
+			commit();
+			Metrics::reached(PUBLISH);
+		}
 	public:
-		SpaceObserver(Space<T>* spc) : spc_(spc), con_(spc->subscribe(boost::bind(&SpaceObserver::fire, this, _1, _2))) { }
+		SpaceObserver(Space<T>* spc) : spc_(spc), con_(spc->subscribe(boost::bind(&SpaceObserver::fire, this, _1, _2))), frameCon_(spc->subscribeFrame(boost::bind(&SpaceObserver::frame, this))) { }
 		
 		virtual ~SpaceObserver()
 		{
 			con_.disconnect();
+			frameCon_.disconnect();
 		}
 		
 		virtual void fire(const ElementEvent& event, int id) = 0;
+		
+		virtual void commit() { }
 	};
 }
 
@@ -0,0 +1,217 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define TRACE_RING_SIZE 16384 // Events kept per thread, a power of two.
+#define TRACE_COOLDOWN 10 // Seconds between two dumps triggered by slow frames.
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) SPRITS::TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+namespace SPRITS
+{
+	// Complete events in the Chrome trace event format, written by their thread into its own ring
+	// without locks. Fields are relaxed atomics so a dump can copy a ring while it is being written,
+	// and discards the slots that may have been overwritten meanwhile.
+	struct TraceEvent
+	{
+		std::atomic<const char*> name;
+		std::atomic<int64_t> begin, end;
+	};
+
+	struct TraceRing
+	{
+		long tid;
+		std::atomic<bool> owned;
+		std::atomic<uint64_t> head;
+		TraceEvent events[TRACE_RING_SIZE];
+		TraceRing() : tid(0), owned(false), head(0) { }
+	};
+
+	class Trace
+	{
+	private:
+		// Binds the calling thread to a ring, rings of exited threads are reused but keep their events until then.
+		struct Owner
+		{
+			TraceRing* ring;
+			Owner() : ring(nullptr)
+			{
+				std::lock_guard<std::mutex> lock(mutex());
+				for (auto& candidate : rings())
+					if (!candidate->owned.load(std::memory_order_relaxed))
+					{
+						ring = candidate.get();
+						break;
+					}
+				if (!ring)
+				{
+					rings().emplace_back(new TraceRing());
+					ring = rings().back().get();
+				}
+				ring->tid = syscall(SYS_gettid);
+				ring->owned.store(true, std::memory_order_relaxed);
+			}
+			~Owner()
+			{
+				ring->owned.store(false, std::memory_order_relaxed);
+			}
+		};
+
+		static std::mutex& mutex()
+		{
+			static std::mutex mutex;
+			return mutex;
+		}
+
+		static std::vector<std::unique_ptr<TraceRing>>& rings()
+		{
+			static std::vector<std::unique_ptr<TraceRing>> rings;
+			return rings;
+		}
+
+		static std::atomic<bool>& requested()
+		{
+			static std::atomic<bool> requested(false);
+			return requested;
+		}
+
+		static std::atomic<int64_t>& slow()
+		{
+			static std::atomic<int64_t> slow(0);
+			return slow;
+		}
+
+		static std::atomic<int64_t>& last()
+		{
+			static std::atomic<int64_t> last(0);
+			return last;
+		}
+	public:
+		static std::atomic<bool>& enabled()
+		{
+			static std::atomic<bool> enabled(false);
+			return enabled;
+		}
+
+		static int64_t now()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		// Starts recording, a frame taking longer than threshold milliseconds in Camera::notify requests a dump, 0 disables the trigger.
+		static void enable(double threshold)
+		{
+			slow().store(static_cast<int64_t>(threshold * 1e6), std::memory_order_relaxed);
+			enabled().store(true, std::memory_order_relaxed);
+		}
+
+		static void record(const char* name, int64_t begin, int64_t end)
+		{
+			static thread_local Owner owner;
+			TraceRing* ring = owner.ring;
+			uint64_t head = ring->head.load(std::memory_order_relaxed);
+			TraceEvent& event = ring->events[head & (TRACE_RING_SIZE - 1)];
+			event.name.store(name, std::memory_order_relaxed);
+			event.begin.store(begin, std::memory_order_relaxed);
+			event.end.store(end, std::memory_order_relaxed);
+			ring->head.store(head + 1, std::memory_order_release);
+		}
+
+		// Safe to call from a signal handler, the dump itself happens on the next poll.
+		static void request()
+		{
+			requested().store(true, std::memory_order_relaxed);
+		}
+
+		static void frame(int64_t begin, int64_t end)
+		{
+			int64_t threshold = slow().load(std::memory_order_relaxed);
+			if ((threshold <= 0) || (end - begin <= threshold))
+				return;
+			int64_t previous = last().load(std::memory_order_relaxed);
+			if ((previous == 0) || (end - previous > TRACE_COOLDOWN * 1000000000LL))
+				if (last().compare_exchange_strong(previous, end, std::memory_order_relaxed))
+					request();
+		}
+
+		// Writes the requested dump, if any, to sprits_<date>_<time>.json and returns its name.
+		static std::string poll()
+		{
+			if (!requested().load(std::memory_order_relaxed) || !requested().exchange(false, std::memory_order_relaxed))
+				return std::string();
+			char name[40];
+			time_t now = time(0);
+			strftime(name, sizeof(name), "sprits_%Y%m%d_%H%M%S.json", localtime(&now));
+			return dump(name) ? name : std::string();
+		}
+
+		static bool dump(const std::string& path)
+		{
+			FILE* out = std::fopen(path.c_str(), "w");
+			if (!out)
+				return false;
+			std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+			bool first = true;
+			long pid = getpid();
+			std::lock_guard<std::mutex> lock(mutex());
+			for (const auto& ring : rings())
+			{
+				uint64_t head = ring->head.load(std::memory_order_acquire);
+				uint64_t begin = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+				std::vector<std::tuple<const char*, int64_t, int64_t>> events;
+				events.reserve(head - begin);
+				for (uint64_t i = begin; i < head; ++i)
+				{
+					const TraceEvent& event = ring->events[i & (TRACE_RING_SIZE - 1)];
+					events.emplace_back(event.name.load(std::memory_order_relaxed), event.begin.load(std::memory_order_relaxed), event.end.load(std::memory_order_relaxed));
+				}
+				uint64_t after = ring->head.load(std::memory_order_acquire);
+				for (uint64_t i = begin; i < head; ++i)
+				{
+					if (i + TRACE_RING_SIZE <= after)
+						continue;
+					const auto& event = events[i - begin];
+					std::fprintf(out, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",", std::get<0>(event), pid, ring->tid, std::get<1>(event) / 1e3, (std::get<2>(event) - std::get<1>(event)) / 1e3);
+					first = false;
+				}
+			}
+			std::fputs("\n]}\n", out);
+			return std::fclose(out) == 0;
+		}
+	};
+
+	// Records the lifetime of the enclosing scope under a name with static storage.
+	class TraceScope
+	{
+	private:
+		const char* name_;
+		int64_t begin_;
+	public:
+		TraceScope(const char* name) : name_(name), begin_(Trace::enabled().load(std::memory_order_relaxed) ? Trace::now() : 0) { }
+
+		~TraceScope()
+		{
+			if (begin_)
+				Trace::record(name_, begin_, Trace::now());
+		}
+
+		int64_t begin() const { return begin_; }
+	};
+}
+
+#endif
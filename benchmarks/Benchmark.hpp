@@ -0,0 +1,99 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+#include <spdlog/spdlog.h>
+
+#define BENCHMARK_ITERATIONS 200 // Timed iterations of every case.
+#define BENCHMARK_WARMUP 20 // Untimed iterations run first to warm caches, allocators and lazy initialisation.
+
+namespace SPRITS
+{
+	// Runs every case for a fixed number of warmed iterations, each timed on its own, and collects a
+	// summary in nanoseconds per operation: cases doing many operations per iteration divide by them.
+	class Benchmark
+	{
+	private:
+		std::size_t iterations_, warmup_;
+		std::string filter_;
+		Json::Value results_;
+
+		static double percentile(const std::vector<double>& sorted, double quantile)
+		{
+			double rank = quantile * (sorted.size() - 1);
+			std::size_t below = std::floor(rank);
+			return (below + 1 < sorted.size()) ? sorted[below] + (rank - below) * (sorted[below + 1] - sorted[below]) : sorted[below];
+		}
+	public:
+		Benchmark(std::size_t iterations = BENCHMARK_ITERATIONS, std::size_t warmup = BENCHMARK_WARMUP, const std::string& filter = "") : iterations_(std::max<std::size_t>(iterations, 1)), warmup_(warmup), filter_(filter), results_(Json::arrayValue) { }
+
+		bool selected(const std::string& name) const
+		{
+			return filter_.empty() || (name.find(filter_) != std::string::npos);
+		}
+
+		// Reset runs untimed before every iteration, for cases that consume their input.
+		Json::Value& run(const std::string& name, const std::map<std::string, Json::Value>& params, std::size_t operations, const std::function<void()>& body, const std::function<void()>& reset = std::function<void()>())
+		{
+			static Json::Value skipped;
+			if (!selected(name))
+				return skipped = Json::Value();
+			for (std::size_t i = 0; i < warmup_; ++i)
+			{
+				if (reset)
+					reset();
+				body();
+			}
+			std::vector<double> samples;
+			samples.reserve(iterations_);
+			for (std::size_t i = 0; i < iterations_; ++i)
+			{
+				if (reset)
+					reset();
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				body();
+				samples.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / operations);
+			}
+			std::sort(samples.begin(), samples.end());
+			double mean = 0, deviation = 0;
+			for (double sample : samples)
+				mean += sample / samples.size();
+			for (double sample : samples)
+				deviation += (sample - mean) * (sample - mean) / samples.size();
+			Json::Value result;
+			result["name"] = name;
+			for (const auto& param : params)
+				result["params"][param.first] = param.second;
+			result["iterations"] = static_cast<Json::UInt64>(iterations_);
+			result["operations"] = static_cast<Json::UInt64>(operations);
+			result["ns"]["min"] = samples.front();
+			result["ns"]["median"] = percentile(samples, 0.5);
+			result["ns"]["mean"] = mean;
+			result["ns"]["p90"] = percentile(samples, 0.9);
+			result["ns"]["p99"] = percentile(samples, 0.99);
+			result["ns"]["max"] = samples.back();
+			result["ns"]["stddev"] = std::sqrt(deviation);
+			std::string label = name;
+			for (const auto& param : params)
+				label += " " + param.first + "=" + param.second.asString();
+			spdlog::get("console")->info("{}: median {:.1f} ns, p99 {:.1f} ns per operation.", label, result["ns"]["median"].asDouble(), result["ns"]["p99"].asDouble());
+			results_.append(result);
+			return results_[results_.size() - 1];
+		}
+
+		const Json::Value& results() const
+		{
+			return results_;
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,481 @@
+#include <docopt.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include <spdlog/spdlog.h>
+
+#include <Camera.hpp>
+#include <Space.hpp>
+
+#include <benchmarks/Benchmark.hpp>
+#include <cameras/Synthetic.cc>
+#include <trackers/ChiliTracker.cc>
+#include <spaces/Plane.cc>
+#include <publishers/WebSocket.cc>
+
+#include <feature_extractor.h>
+#include <TUIO/TuioServer.h>
+#include <TUIO/UdpSender.h>
+#include <websocketpp/client.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+
+#define BENCHMARK_FRAMES 30 // Distinct frames rendered for every camera configuration, replayed in a loop.
+#define BENCHMARK_GATE 20 // Pixels from a true fingertip within which a detected one may match it.
+
+using namespace SPRITS;
+
+static const char USAGE[] =
+R"(SPRITS microbenchmarks.
+
+    Usage:
+      Benchmarks [options]
+
+    Options:
+      --help               Show this screen.
+      --depth=<file>       Also run the finger cases on recorded 640x480 depth frames, raw little-endian uint16.
+      --filter=<name>      Only run the cases whose name contains <name>.
+      --iterations=<n>     Timed iterations per case [default: 200].
+      --output=<file>      Write the results as JSON to <file> [default: benchmarks.json].
+      --port=<port>        Port of the benchmarked WebSocket server [default: 19002].
+      --warmup=<n>         Untimed iterations per case [default: 20].
+      --version            Show version.
+)";
+
+typedef std::tuple<double, double, double> Pose;
+
+// Stands in for the trackers decorated by the benchmarked ones.
+class NullTracker : public CameraObserver<Pose>
+{
+public:
+	NullTracker(Camera *cam, Space<Pose> *spc, const NewFrameEvent& event) : CameraObserver<Pose>(cam, spc, event) { }
+
+	void fire(const NewFrameEvent& event, const cv::Mat& frame) { }
+};
+
+// Frames with the ground truth the camera exposed while notifying each of them, empty for recordings.
+struct Recording
+{
+	std::vector<cv::Mat> frames;
+	std::vector<std::map<int, Pose>> tags;
+	std::vector<std::vector<Pose>> fingertips;
+};
+
+class FrameGrabber : public CameraObserver<Pose>
+{
+private:
+	Synthetic& synthetic_;
+public:
+	Recording recording;
+
+	FrameGrabber(Synthetic& cam, Space<Pose> *spc, const NewFrameEvent& event) : CameraObserver<Pose>(&cam, spc, event), synthetic_(cam) { }
+
+	void fire(const NewFrameEvent& event, const cv::Mat& frame)
+	{
+		recording.frames.push_back(frame.clone());
+		recording.tags.push_back(synthetic_.tags());
+		recording.fingertips.push_back(synthetic_.fingertips());
+	}
+};
+
+// Stands in for the publishers, and counts the elements alive.
+class ElementCounter : public SpaceObserver<Pose>
+{
+public:
+	std::set<int> alive;
+
+	ElementCounter(Space<Pose> *spc) : SpaceObserver<Pose>(spc) { }
+
+	void fire(const ElementEvent& event, int id)
+	{
+		if (event.get_state() == REMOVE)
+			alive.erase(id);
+		else
+			alive.insert(id);
+	}
+};
+
+// Detections scored against the ground truth of their frame, positions in pixels.
+class Accuracy
+{
+private:
+	std::size_t frames_, truths_, matched_, spurious_;
+	double error_, worst_;
+
+	void match(double error)
+	{
+		++matched_;
+		error_ += error;
+		worst_ = std::max(worst_, error);
+	}
+public:
+	Accuracy() : frames_(0), truths_(0), matched_(0), spurious_(0), error_(0), worst_(0) { }
+
+	// Tags carry their id, a detection only matches the truth of the same id.
+	void score(const std::map<int, Pose>& truth, const std::map<int, cv::Point2d>& detected)
+	{
+		++frames_;
+		truths_ += truth.size();
+		for (const auto& tag : detected)
+		{
+			auto it = truth.find(tag.first);
+			if (it == truth.end())
+				++spurious_;
+			else
+				match(cv::norm(tag.second - cv::Point2d(std::get<0>(it->second), std::get<1>(it->second))));
+		}
+	}
+
+	// Fingertips carry no id, so each detection matches the nearest fingertip within BENCHMARK_GATE, closest pairs first.
+	void score(const std::vector<Pose>& truth, const std::vector<cv::Point2d>& detected)
+	{
+		++frames_;
+		truths_ += truth.size();
+		std::vector<std::tuple<double, std::size_t, std::size_t>> pairs;
+		for (std::size_t i = 0; i < detected.size(); ++i)
+			for (std::size_t j = 0; j < truth.size(); ++j)
+			{
+				double distance = cv::norm(detected[i] - cv::Point2d(std::get<0>(truth[j]), std::get<1>(truth[j])));
+				if (distance <= BENCHMARK_GATE)
+					pairs.push_back(std::make_tuple(distance, i, j));
+			}
+		std::sort(pairs.begin(), pairs.end());
+		std::vector<bool> found(detected.size(), false), taken(truth.size(), false);
+		for (const auto& pair : pairs)
+			if (!found[std::get<1>(pair)] && !taken[std::get<2>(pair)])
+			{
+				found[std::get<1>(pair)] = taken[std::get<2>(pair)] = true;
+				match(std::get<0>(pair));
+			}
+		spurious_ += std::count(found.begin(), found.end(), false);
+	}
+
+	// Recall is the fraction of the truth matched, spurious the unmatched detections per frame.
+	void report(Json::Value& result) const
+	{
+		if (result.isNull() || (frames_ == 0))
+			return;
+		result["accuracy"]["recall"] = (truths_ > 0) ? static_cast<double>(matched_) / truths_ : 1.0;
+		result["accuracy"]["spurious"] = static_cast<double>(spurious_) / frames_;
+		result["accuracy"]["error"]["mean"] = (matched_ > 0) ? error_ / matched_ : 0.0;
+		result["accuracy"]["error"]["max"] = worst_;
+	}
+};
+
+static Recording render(Synthetic& cam, const NewFrameEvent& event, std::size_t count)
+{
+	Plane plane;
+	FrameGrabber grabber(cam, &plane, event);
+	while (grabber.recording.frames.size() < count)
+		cam.update();
+	return grabber.recording;
+}
+
+static std::map<int, cv::Point2d> centers(const chilitags::TagCornerMap& tags)
+{
+	std::map<int, cv::Point2d> centers;
+	for (const auto& tag : tags)
+	{
+		const cv::Mat_<cv::Point2f> corners(tag.second);
+		cv::Point2f center = 0.5 * (corners(0) + corners(2));
+		centers[tag.first] = cv::Point2d(center.x, center.y);
+	}
+	return centers;
+}
+
+static Pose pose(std::size_t id, std::size_t iteration)
+{
+	return std::make_tuple(0.5 + 0.4 * std::cos(id + 0.01 * iteration), 0.5 + 0.4 * std::sin(id + 0.01 * iteration), std::remainder(0.1 * id + 0.01 * iteration, 2 * M_PI));
+}
+
+// Feeds FeatureExtractor the same inputs as FingerTracker, the depth converted to distances through
+// its gamma table, in a back buffer refreshed before every iteration since Process draws into it.
+static void fingers(Benchmark& benchmark, const std::string& source, std::size_t hands, const Recording& recording)
+{
+	const std::vector<cv::Mat>& frames = recording.frames;
+	if (!benchmark.selected("FeatureExtractor::Process") || frames.empty())
+		return;
+	uint16_t gamma[2048];
+	for (int i = 0; i < 2048; ++i)
+		gamma[i] = std::pow(i / 2048.0, 3) * 6 * 6 * 256;
+	std::vector<std::vector<int>> distances;
+	std::vector<int> minimums;
+	for (const auto& frame : frames)
+	{
+		distances.push_back(std::vector<int>(frame.total()));
+		minimums.push_back(255 * 5);
+		const uint16_t* depth = frame.ptr<uint16_t>();
+		for (std::size_t i = 0; i < frame.total(); ++i)
+		{
+			int value = gamma[std::min<uint16_t>(depth[i], 2047)];
+			distances.back()[i] = 255 * (value >> 8) + (value & 0xff);
+			minimums.back() = std::min(minimums.back(), distances.back()[i]);
+		}
+	}
+	FeatureExtractor extractor(SYNTHETIC_DEPTH_WIDTH, SYNTHETIC_DEPTH_HEIGHT);
+	std::vector<uint8_t> buffer(SYNTHETIC_DEPTH_WIDTH * SYNTHETIC_DEPTH_HEIGHT * 3);
+	std::size_t next = 0, current = 0, found = 0, runs = 0;
+	bool scored = recording.fingertips.size() == frames.size();
+	Accuracy accuracy;
+	std::vector<cv::Point2d> tips;
+	Json::Value& result = benchmark.run("FeatureExtractor::Process", { { "source", source }, { "hands", static_cast<Json::UInt64>(hands) } }, 1, [&] {
+		extractor.Process(buffer.data(), distances[current].data(), minimums[current]);
+		found += extractor.GetNumFingerTips();
+		++runs;
+		if (!scored)
+			return;
+		tips.clear();
+		for (int i = 0; i < extractor.GetNumFingerTips(); ++i)
+			tips.push_back(cv::Point2d(extractor.GetFingerVectors()[i].end % SYNTHETIC_DEPTH_WIDTH, extractor.GetFingerVectors()[i].end / SYNTHETIC_DEPTH_WIDTH));
+		accuracy.score(recording.fingertips[current], tips);
+	}, [&] {
+		current = next++ % frames.size();
+		std::memcpy(buffer.data(), frames[current].data, frames[current].total() * frames[current].elemSize());
+	});
+	if (!result.isNull())
+		result["fingertips"] = static_cast<double>(found) / runs;
+	accuracy.report(result);
+}
+
+// Chilitags detects tags in the whole frame and tracks them from the previous frame around their last
+// position. ChiliTracker detects periodically on a background thread, so its fire mostly measures
+// tracking: detection is measured on its own, synchronously, and so is tracking, from an untimed
+// detection in the previous frame. Detections are scored against the tags drawn in their frame.
+static void chilitags(Benchmark& benchmark, int width, int height, std::size_t tags)
+{
+	if (!benchmark.selected("Chilitags::find") && !benchmark.selected("ChiliTracker::fire"))
+		return;
+	Synthetic cam(width, height, 1000, tags, 0);
+	Recording recording = render(cam, NewFrameEvent::COLOR, BENCHMARK_FRAMES);
+	const std::vector<cv::Mat>& frames = recording.frames;
+	std::map<std::string, Json::Value> params = { { "width", width }, { "height", height }, { "tags", static_cast<Json::UInt64>(tags) } };
+	chilitags::Chilitags detector;
+	detector.setFilter(0, 0.0f);
+	std::size_t next = 0, current = 0;
+	Accuracy detected;
+	params["trigger"] = "detect";
+	Json::Value& detection = benchmark.run("Chilitags::find", params, 1, [&] {
+		current = next++ % frames.size();
+		detected.score(recording.tags[current], centers(detector.find(frames[current], chilitags::Chilitags::DETECT_ONLY)));
+	});
+	detected.report(detection);
+	next = 0;
+	Accuracy tracked;
+	params["trigger"] = "track";
+	Json::Value& tracking = benchmark.run("Chilitags::find", params, 1, [&] {
+		tracked.score(recording.tags[current + 1], centers(detector.find(frames[current + 1], chilitags::Chilitags::TRACK_ONLY)));
+	}, [&] {
+		current = next++ % (frames.size() - 1);
+		detector.find(frames[current], chilitags::Chilitags::DETECT_ONLY);
+	});
+	tracked.report(tracking);
+	params.erase("trigger");
+	// Unsmoothed, so the plane holds what the tracker found; it scales x by the rows and y by the columns.
+	Plane plane(0);
+	ElementCounter counter(&plane);
+	ChiliTracker tracker(new NullTracker(&cam, &plane, NewFrameEvent::COLOR));
+	next = 0;
+	Accuracy fired;
+	std::map<int, cv::Point2d> elements;
+	Json::Value& result = benchmark.run("ChiliTracker::fire", params, 1, [&] {
+		current = next++ % frames.size();
+		tracker.fire(NewFrameEvent::COLOR, frames[current]);
+		elements.clear();
+		for (int id : counter.alive)
+			elements[id] = cv::Point2d(std::get<0>(plane.getElement(id)) * frames[current].rows, std::get<1>(plane.getElement(id)) * frames[current].cols);
+		fired.score(recording.tags[current], elements);
+	});
+	fired.report(result);
+}
+
+static void plane(Benchmark& benchmark, std::size_t elements)
+{
+	Plane plane;
+	std::size_t iteration = 0;
+	benchmark.run("Plane::setElement", { { "elements", static_cast<Json::UInt64>(elements) } }, elements, [&] {
+		++iteration;
+		for (std::size_t id = 0; id < elements; ++id)
+			plane.setElement(id, pose(id, iteration));
+		plane.commit();
+	});
+	for (std::size_t id = 0; id < elements; ++id)
+		plane.setElement(id, pose(id, 0));
+	plane.commit();
+	double sum = 0;
+	benchmark.run("Plane::getElement", { { "elements", static_cast<Json::UInt64>(elements) } }, elements, [&] {
+		for (std::size_t id = 0; id < elements; ++id)
+			sum += std::get<0>(plane.getElement(id));
+	});
+	spdlog::get("console")->debug("Checksum {}.", sum);
+}
+
+static void dispatch(Benchmark& benchmark, std::size_t observers)
+{
+	Plane plane;
+	std::vector<std::unique_ptr<ElementCounter>> counters;
+	for (std::size_t i = 0; i < observers; ++i)
+		counters.emplace_back(new ElementCounter(&plane));
+	benchmark.run("Space::notify", { { "observers", static_cast<Json::UInt64>(observers) } }, 1000, [&] {
+		for (int id = 0; id < 1000; ++id)
+			plane.notify(ElementEvent(UPDATE), id);
+	});
+}
+
+// WebSocket clients discarding whatever they receive, the publisher only encodes for the encodings in use.
+class Viewers
+{
+private:
+	typedef websocketpp::client<websocketpp::config::asio_client> client_type;
+	client_type client_;
+	std::thread thread_;
+	std::atomic<std::size_t> open_;
+public:
+	Viewers(int port, std::size_t count, bool binary) : open_(0)
+	{
+		client_.clear_access_channels(websocketpp::log::alevel::all);
+		client_.clear_error_channels(websocketpp::log::elevel::all);
+		client_.init_asio();
+		client_.set_open_handler([this](websocketpp::connection_hdl hdl) { ++open_; });
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			websocketpp::lib::error_code ec;
+			client_type::connection_ptr con = client_.get_connection("ws://localhost:" + std::to_string(port), ec);
+			if (ec)
+				throw std::runtime_error("Cannot connect benchmark viewers: " + ec.message());
+			if (binary)
+				con->add_subprotocol(BINARY_PROTOCOL);
+			client_.connect(con);
+		}
+		thread_ = std::thread([this] { client_.run(); });
+		for (int i = 0; (i < 200) && (open_ < count); ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		if (open_ < count)
+			throw std::runtime_error("Benchmark viewers failed to connect.");
+		// The server registers a client just after answering its handshake.
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	~Viewers()
+	{
+		client_.stop();
+		thread_.join();
+	}
+};
+
+// Every element changes in every frame, so commit encodes one JSON message per element for JSON viewers,
+// the binary batch for binary ones, and nothing without viewers.
+static void websocket(Benchmark& benchmark, int port, std::size_t elements, const std::string& viewers)
+{
+	if (!benchmark.selected("WebSocketPublisher::commit"))
+		return;
+	Plane plane;
+	for (std::size_t id = 0; id < elements; ++id)
+		plane.setElement(id, pose(id, 0));
+	plane.commit();
+	WebSocketPublisher publisher(&plane, port);
+	std::unique_ptr<Viewers> connected((viewers == "none") ? nullptr : new Viewers(port, 1, viewers == "binary"));
+	benchmark.run("WebSocketPublisher::commit", { { "elements", static_cast<Json::UInt64>(elements) }, { "viewers", viewers } }, elements, [&] {
+		for (std::size_t id = 0; id < elements; ++id)
+			publisher.fire(ElementEvent(UPDATE), id);
+		publisher.commit();
+	});
+}
+
+static void tuio(Benchmark& benchmark, std::size_t elements)
+{
+	if (!benchmark.selected("TuioServer::commitFrame"))
+		return;
+	std::unique_ptr<TUIO::UdpSender> sender(new TUIO::UdpSender("localhost", 3333));
+	std::unique_ptr<TUIO::TuioServer> server(new TUIO::TuioServer(sender.get()));
+	server->setVerbose(false);
+	std::vector<TUIO::TuioObject*> objects;
+	server->initFrame(TUIO::TuioTime::getSessionTime());
+	for (std::size_t id = 0; id < elements; ++id)
+		objects.push_back(server->addTuioObject(id, std::get<0>(pose(id, 0)), std::get<1>(pose(id, 0)), std::get<2>(pose(id, 0))));
+	server->commitFrame();
+	std::size_t iteration = 0;
+	benchmark.run("TuioServer::commitFrame", { { "elements", static_cast<Json::UInt64>(elements) } }, 1, [&] {
+		server->commitFrame();
+	}, [&] {
+		++iteration;
+		server->initFrame(TUIO::TuioTime::getSessionTime());
+		for (std::size_t id = 0; id < elements; ++id)
+			server->updateTuioObject(objects[id], std::get<0>(pose(id, iteration)), std::get<1>(pose(id, iteration)), std::get<2>(pose(id, iteration)));
+	});
+}
+
+static std::vector<cv::Mat> recorded(const std::string& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+		throw std::runtime_error("Cannot open depth recording " + path + ".");
+	std::vector<cv::Mat> frames;
+	for (;;)
+	{
+		cv::Mat1w frame(SYNTHETIC_DEPTH_HEIGHT, SYNTHETIC_DEPTH_WIDTH);
+		if (!in.read(reinterpret_cast<char*>(frame.data), frame.total() * frame.elemSize()))
+			break;
+		frames.push_back(frame);
+	}
+	return frames;
+}
+
+int main(int argc, char **argv)
+{
+	auto console = spdlog::stdout_logger_mt("console", true);
+	try
+	{
+		std::map<std::string, docopt::value> args = docopt::docopt(USAGE, { argv + 1, argv + argc }, true, "SPRITS 1.0");
+		Benchmark benchmark(boost::lexical_cast<std::size_t>(args["--iterations"].asString()), boost::lexical_cast<std::size_t>(args["--warmup"].asString()), args["--filter"] ? args["--filter"].asString() : "");
+		for (std::size_t hands : { 1, 4 })
+		{
+			if (!benchmark.selected("FeatureExtractor::Process"))
+				break;
+			Synthetic cam(640, 480, 1000, 0, hands);
+			fingers(benchmark, "synthetic", hands, render(cam, NewFrameEvent::DEPTH, BENCHMARK_FRAMES));
+		}
+		if (args["--depth"])
+			fingers(benchmark, args["--depth"].asString(), 0, Recording { recorded(args["--depth"].asString()) });
+		for (const auto& resolution : { std::make_pair(640, 480), std::make_pair(1280, 720), std::make_pair(1920, 1080) })
+			for (std::size_t tags : { 1, 20, 100 })
+				chilitags(benchmark, resolution.first, resolution.second, tags);
+		for (std::size_t elements : { 10, 100, 1000 })
+			plane(benchmark, elements);
+		for (std::size_t observers : { 1, 4, 16 })
+			dispatch(benchmark, observers);
+		for (const char* viewers : { "none", "json", "binary" })
+			for (std::size_t elements : { 10, 100, 1000 })
+				websocket(benchmark, boost::lexical_cast<int>(args["--port"].asString()), elements, viewers);
+		// A TUIO frame must fit a single UDP packet, about 800 objects.
+		for (std::size_t elements : { 10, 100, 500 })
+			tuio(benchmark, elements);
+		Json::Value root;
+		root["version"] = "SPRITS 1.0";
+		root["time"] = static_cast<Json::UInt64>(std::time(0));
+		root["iterations"] = boost::lexical_cast<Json::UInt64>(args["--iterations"].asString());
+		root["warmup"] = boost::lexical_cast<Json::UInt64>(args["--warmup"].asString());
+		root["results"] = benchmark.results();
+		std::ofstream out(args["--output"].asString());
+		out << Json::StyledWriter().write(root);
+		if (!out)
+			throw std::runtime_error("Cannot write " + args["--output"].asString() + ".");
+	} catch (std::exception& e)
+	{
+		spdlog::get("console")->critical("ERROR: {}", e.what());
+		spdlog::drop_all();
+		return 1;
+	}
+	spdlog::drop_all();
+	return 0;
+}
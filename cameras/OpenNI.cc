@@ -53,16 +53,23 @@ class OpenNI : public Camera
 	template<typename T>
 	struct Listener : public openni::VideoStream::NewFrameListener
 	{
-		std::function<void(T)> cb;
+		NewFrameEvent event;
+		int last;
+		std::function<void(T, MotionClock::time_point)> cb;
+		Listener(NewFrameEvent event) : event(event), last(-1) { }
 		virtual void onNewFrame(openni::VideoStream &stream)
 		{
+			MotionClock::time_point sensor = MotionClock::now();
 			openni::VideoFrameRef frame;
 			stream.readFrame(&frame);
+			if ((last >= 0) && (frame.getFrameIndex() > last + 1))
+				Metrics::stream(static_cast<std::size_t>(event)).dropped.fetch_add(frame.getFrameIndex() - last - 1, std::memory_order_relaxed);
+			last = frame.getFrameIndex();
 			T img(frame.getHeight(), frame.getWidth());
 			for (int y = 0; y < img.rows; ++y)
 				memcpy(img.ptr(y), ((uint8_t *)frame.getData()) + y*frame.getStrideInBytes(), img.cols*img.elemSize());
 			frame.release();
-			if (cb && img.data) cb(img);
+			if (cb && img.data) cb(img, sensor);
 		}
 	};
 	
@@ -104,7 +111,7 @@ protected:
 public:
 	OpenNI(bool crop = false, bool debug = false) : OpenNI(4, 9, crop, debug) { };
 	
-	OpenNI(int dmode, int cmode, bool crop = false, bool debug = false) : Camera(crop, debug)
+	OpenNI(int dmode, int cmode, bool crop = false, bool debug = false) : Camera(crop, debug), colorListener(NewFrameEvent::COLOR), depthListener(NewFrameEvent::DEPTH)
 	{
 		spdlog::get("console")->info("Opening OpenNI device...");
 		openni::OpenNI::initialize();
@@ -132,8 +139,8 @@ public:
 			throw std::runtime_error("Unsupported depth video mode!");
 
 
-		colorListener.cb = [&](cv::Mat3b color_) { cv::cvtColor(color_, color_, CV_BGR2RGB); notify(NewFrameEvent::COLOR, color_); color_.release(); };
-		depthListener.cb = [&](cv::Mat1s depth_) { notify(NewFrameEvent::DEPTH, depth_); depth_.release(); };
+		colorListener.cb = [&](cv::Mat3b color_, MotionClock::time_point sensor) { cv::cvtColor(color_, color_, CV_BGR2RGB); notify(NewFrameEvent::COLOR, color_, sensor); color_.release(); };
+		depthListener.cb = [&](cv::Mat1s depth_, MotionClock::time_point sensor) { notify(NewFrameEvent::DEPTH, depth_, sensor); depth_.release(); };
 		colorStream.addNewFrameListener(&colorListener);
 		depthStream.addNewFrameListener(&depthListener);
 
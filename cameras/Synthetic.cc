@@ -0,0 +1,277 @@
+#ifndef SYNTHETIC_CC
+#define SYNTHETIC_CC
+
+#include <Camera.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <chilitags/chilitags.hpp>
+#include <spdlog/spdlog.h>
+
+#define SYNTHETIC_SCENE "1280x720@30,20,1" // <width>x<height>@<fps>,<tags>,<hands>
+#define SYNTHETIC_DEPTH_WIDTH 640 // FingerTracker expects 640x480 depth maps whatever the color resolution.
+#define SYNTHETIC_DEPTH_HEIGHT 480
+#define SYNTHETIC_TAG_SIZE 0.1 // Tag side, margin included, as a fraction of the frame height.
+#define SYNTHETIC_SPEED 0.2 // Maximum speed of tags and hands in frame heights per second.
+#define SYNTHETIC_SPIN 1.0 // Maximum angular speed in radians per second.
+#define SYNTHETIC_PLANE 1000 // Raw depth of the table, within the 11-bit range of Kinect raw depth.
+#define SYNTHETIC_HAND 40 // Raw depth of hands above the table.
+#define SYNTHETIC_NOISE 2.0 // Standard deviation of the depth noise in raw units.
+#define SYNTHETIC_DROPOUT 0.01 // Fraction of depth samples reported as invalid.
+#define SYNTHETIC_SEED 42
+#define SYNTHETIC_ATTEMPTS 100 // Spawns tried before a tag may overlap another one, in crowded scenes.
+
+using namespace SPRITS;
+
+// Renders a procedural scene instead of reading a sensor: chilitags moving and spinning over a
+// textured table in the color stream, and open hands moving over the table in the depth stream,
+// with noise and invalid samples. Scenes are reproducible for a given seed, and the ground truth
+// of the frame being notified is available to observers through tags() and fingertips(). Tags
+// bounce off each other, and those partly hidden or cropped out are left out of the truth.
+class Synthetic : public Camera
+{
+public:
+	typedef std::tuple<double, double, double> Pose;
+private:
+	struct Body
+	{
+		double x, y, angle, vx, vy, spin;
+	};
+
+	int width_, height_;
+	std::size_t tags_, hands_;
+	MotionClock::duration period_;
+	MotionClock::time_point next_;
+	std::mt19937 rng_;
+	cv::Mat3b texture_, color_;
+	cv::Mat1w depth_;
+	std::vector<Body> tagBodies_, handBodies_;
+	std::vector<cv::Mat3b> patterns_;
+	std::map<int, Pose> truth_;
+	std::vector<Pose> fingertips_;
+	cv::Rect roi_;
+	double margin_;
+	bool cropped_;
+
+	// Bodies are discs of radius margin, which overlap when their centers are closer than twice that.
+	static bool overlap(const Body& a, const Body& b, double margin)
+	{
+		return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y) < 4 * margin * margin;
+	}
+
+	Body spawn(int width, int height, double margin, const std::vector<Body>& others = std::vector<Body>())
+	{
+		std::uniform_real_distribution<double> unit(0, 1), sign(-1, 1);
+		Body body;
+		for (int attempt = 0; attempt < SYNTHETIC_ATTEMPTS; ++attempt)
+		{
+			double direction = unit(rng_) * 2 * M_PI, speed = unit(rng_) * SYNTHETIC_SPEED * height;
+			body = Body { margin + unit(rng_) * (width - 2 * margin), margin + unit(rng_) * (height - 2 * margin), sign(rng_) * M_PI, speed * std::cos(direction), speed * std::sin(direction), sign(rng_) * SYNTHETIC_SPIN };
+			if (std::none_of(others.begin(), others.end(), [&](const Body& other) { return overlap(body, other, margin); }))
+				break;
+		}
+		return body;
+	}
+
+	// Bodies about to overlap within dt exchange their velocities along the line of their centers.
+	static void collide(Body& a, Body& b, double dt, double margin)
+	{
+		Body movedA = a, movedB = b;
+		movedA.x += a.vx * dt;
+		movedA.y += a.vy * dt;
+		movedB.x += b.vx * dt;
+		movedB.y += b.vy * dt;
+		double dx = b.x - a.x, dy = b.y - a.y, distance = std::hypot(dx, dy);
+		if (!overlap(movedA, movedB, margin) || (distance == 0))
+			return;
+		double nx = dx / distance, ny = dy / distance, closing = (a.vx - b.vx) * nx + (a.vy - b.vy) * ny;
+		if (closing <= 0)
+			return;
+		a.vx -= closing * nx;
+		a.vy -= closing * ny;
+		b.vx += closing * nx;
+		b.vy += closing * ny;
+	}
+
+	// Bodies bounce on the borders so they never leave the frame.
+	static void move(Body& body, double dt, int width, int height, double margin)
+	{
+		body.x += body.vx * dt;
+		body.y += body.vy * dt;
+		body.angle = std::remainder(body.angle + body.spin * dt, 2 * M_PI);
+		if (((body.x < margin) && (body.vx < 0)) || ((body.x > width - margin) && (body.vx > 0)))
+			body.vx = -body.vx;
+		if (((body.y < margin) && (body.vy < 0)) || ((body.y > height - margin) && (body.vy > 0)))
+			body.vy = -body.vy;
+	}
+
+	// The truth is given in the pixels of view, the frame actually notified.
+	void renderColor(const cv::Rect& view)
+	{
+		texture_.copyTo(color_);
+		truth_.clear();
+		for (std::size_t i = 0; i < tagBodies_.size(); ++i)
+		{
+			const Body& body = tagBodies_[i];
+			const cv::Mat3b& pattern = patterns_[i];
+			double c = std::cos(body.angle), s = std::sin(body.angle), half = pattern.cols / 2.0, radius = half * M_SQRT2;
+			cv::Rect box = cv::Rect(std::floor(body.x - radius), std::floor(body.y - radius), std::ceil(2 * radius) + 1, std::ceil(2 * radius) + 1) & cv::Rect(0, 0, width_, height_);
+			if (box.area() == 0)
+				continue;
+			// Maps the pattern center onto the body and its top edge along the body angle, as ChiliTracker measures it.
+			cv::Mat transform = (cv::Mat_<double>(2, 3) << c, -s, body.x - box.x - c * half + s * half, s, c, body.y - box.y - s * half - c * half);
+			cv::Mat3b target = color_(box);
+			cv::warpAffine(pattern, target, transform, box.size(), cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+			double extent = half * (std::fabs(c) + std::fabs(s));
+			if ((body.x - extent < view.x) || (body.y - extent < view.y) || (body.x + extent > view.x + view.width) || (body.y + extent > view.y + view.height))
+				continue;
+			truth_[i] = std::make_tuple(body.x - view.x, body.y - view.y, body.angle);
+		}
+		// Tags drawn later cover the earlier ones.
+		for (auto it = truth_.begin(); it != truth_.end();)
+		{
+			std::size_t i = it->first;
+			if (std::any_of(tagBodies_.begin() + i + 1, tagBodies_.end(), [&](const Body& other) { return overlap(tagBodies_[i], other, margin_); }))
+				it = truth_.erase(it);
+			else
+				++it;
+		}
+	}
+
+	void renderDepth()
+	{
+		double scale = SYNTHETIC_DEPTH_HEIGHT, palm = 0.07 * scale, finger = 0.09 * scale;
+		int thickness = std::max(1, static_cast<int>(0.025 * scale));
+		depth_.setTo(SYNTHETIC_PLANE);
+		fingertips_.clear();
+		for (const auto& body : handBodies_)
+		{
+			uint16_t hand = SYNTHETIC_PLANE - SYNTHETIC_HAND;
+			cv::ellipse(depth_, cv::Point(body.x, body.y), cv::Size(palm, palm * 1.2), body.angle * 180 / M_PI, 0, 360, cv::Scalar(hand), -1);
+			// Thumb first, the other fingers spread around the hand direction.
+			for (double spread : { -1.4, -0.45, -0.15, 0.15, 0.45 })
+			{
+				double angle = body.angle + spread, length = palm + ((spread == -1.4) ? 0.7 : 1.0) * finger;
+				cv::Point2d tip(body.x + length * std::cos(angle), body.y + length * std::sin(angle));
+				cv::line(depth_, cv::Point(body.x, body.y), tip, cv::Scalar(hand), thickness);
+				cv::circle(depth_, tip, thickness / 2, cv::Scalar(hand), -1);
+				fingertips_.push_back(std::make_tuple(tip.x, tip.y, angle));
+			}
+		}
+		cv::Mat1s noise(depth_.size());
+		cv::randn(noise, 0, SYNTHETIC_NOISE);
+		cv::add(depth_, noise, depth_, cv::noArray(), CV_16U);
+		std::uniform_int_distribution<int> pixel(0, depth_.total() - 1);
+		for (std::size_t i = 0, n = depth_.total() * SYNTHETIC_DROPOUT; i < n; ++i)
+		{
+			int index = pixel(rng_);
+			depth_(index / depth_.cols, index % depth_.cols) = 0;
+		}
+	}
+protected:
+	void setCropping(boost::tuple<int, int> origin, boost::tuple<int, int> target)
+	{
+		roi_ = cv::Rect(cv::Point(boost::get<0>(origin), boost::get<1>(origin)), cv::Point(boost::get<0>(target), boost::get<1>(target))) & cv::Rect(0, 0, width_, height_);
+		cropped_ = true;
+		spdlog::get("console")->debug("Cropping data received.");
+	}
+
+	void resetCropping()
+	{
+		cropped_ = false;
+		spdlog::get("console")->debug("Cropping data reset requested.");
+	}
+public:
+	Synthetic(bool crop = false, bool debug = false) : Synthetic(SYNTHETIC_SCENE, crop, debug) { };
+
+	Synthetic(const std::string& scene, bool crop = false, bool debug = false, unsigned int seed = SYNTHETIC_SEED) : Synthetic(parse(scene, 0), parse(scene, 1), parse(scene, 2), parse(scene, 3), parse(scene, 4), crop, debug, seed) { };
+
+	Synthetic(int width, int height, double fps, std::size_t tags, std::size_t hands, bool crop = false, bool debug = false, unsigned int seed = SYNTHETIC_SEED) : Camera(crop, debug), width_(width), height_(height), tags_(std::min<std::size_t>(tags, 1024)), hands_(hands), period_(std::chrono::duration_cast<MotionClock::duration>(std::chrono::duration<double>(1 / fps))), rng_(seed), depth_(SYNTHETIC_DEPTH_HEIGHT, SYNTHETIC_DEPTH_WIDTH), margin_(0), cropped_(false)
+	{
+		spdlog::get("console")->info("Opening synthetic camera...");
+		if ((width <= 0) || (height <= 0) || (fps <= 0))
+			throw std::runtime_error("Invalid synthetic camera resolution or frame rate!");
+		cv::Mat1b noise(height, width);
+		cv::randu(noise, 90, 170);
+		cv::GaussianBlur(noise, noise, cv::Size(0, 0), 3);
+		cv::cvtColor(noise, texture_, cv::COLOR_GRAY2BGR);
+		chilitags::Chilitags drawer;
+		int cell = std::max(1, static_cast<int>(SYNTHETIC_TAG_SIZE * height / 10));
+		margin_ = cell * 10 * M_SQRT1_2;
+		for (std::size_t i = 0; i < tags_; ++i)
+		{
+			cv::Mat pattern = drawer.draw(i, cell, true, cv::Scalar(0, 0, 0));
+			if (pattern.channels() == 1)
+				cv::cvtColor(pattern, pattern, cv::COLOR_GRAY2BGR);
+			patterns_.push_back(pattern);
+			tagBodies_.push_back(spawn(width, height, margin_, tagBodies_));
+		}
+		for (std::size_t i = 0; i < hands_; ++i)
+			handBodies_.push_back(spawn(SYNTHETIC_DEPTH_WIDTH, SYNTHETIC_DEPTH_HEIGHT, 0.2 * SYNTHETIC_DEPTH_HEIGHT));
+		next_ = MotionClock::now();
+		spdlog::get("console")->info("Synthetic camera opened successfully with {} tags and {} hands at {}x{}, {} FPS!", tags_, hands_, width, height, fps);
+	}
+
+	~Synthetic()
+	{
+		spdlog::get("console")->info("Closing synthetic camera...");
+		spdlog::get("console")->info("Synthetic camera closed successfully!");
+	}
+
+	static double parse(const std::string& scene, int field)
+	{
+		int width, height, tags, hands;
+		double fps;
+		if (std::sscanf(scene.c_str(), "%dx%d@%lf,%d,%d", &width, &height, &fps, &tags, &hands) != 5)
+			throw std::runtime_error("Invalid synthetic scene " + scene + ".");
+		double fields[] = { static_cast<double>(width), static_cast<double>(height), fps, static_cast<double>(tags), static_cast<double>(hands) };
+		return fields[field];
+	}
+
+	// Ground truth of the frame being notified: centers of the fully visible tags in color pixels of the
+	// cropped frame when cropping, with the angle of their top edge.
+	const std::map<int, Pose>& tags() const
+	{
+		return truth_;
+	}
+
+	// Ground truth of the frame being notified: fingertips in depth pixels with the direction of their finger.
+	const std::vector<Pose>& fingertips() const
+	{
+		return fingertips_;
+	}
+
+	// Frames are due every period after the previous one, a renderer running late skips ahead instead of bursting.
+	void update()
+	{
+		std::this_thread::sleep_until(next_);
+		MotionClock::time_point sensor = next_;
+		double dt = std::chrono::duration_cast<std::chrono::duration<double>>(period_).count();
+		next_ = std::max(next_ + period_, MotionClock::now());
+		for (std::size_t i = 0; i < tagBodies_.size(); ++i)
+			for (std::size_t j = i + 1; j < tagBodies_.size(); ++j)
+				collide(tagBodies_[i], tagBodies_[j], dt, margin_);
+		for (auto& body : tagBodies_)
+			move(body, dt, width_, height_, margin_);
+		for (auto& body : handBodies_)
+			move(body, dt, SYNTHETIC_DEPTH_WIDTH, SYNTHETIC_DEPTH_HEIGHT, 0.2 * SYNTHETIC_DEPTH_HEIGHT);
+		cv::Rect view = cropped_ ? roi_ : cv::Rect(0, 0, width_, height_);
+		renderColor(view);
+		notify(NewFrameEvent::COLOR, color_(view), sensor);
+		renderDepth();
+		notify(NewFrameEvent::DEPTH, depth_, sensor);
+		Camera::update();
+	}
+};
+
+#endif
@@ -55,6 +55,7 @@ public:
 	{
 		if (capture->read(inputImage))
 		{
+			MotionClock::time_point sensor = MotionClock::now();
 			if (cropped)
 			{
 				cv::Rect roi;
@@ -64,7 +65,7 @@ public:
 		    	roi.height = boost::get<1>(cropTarget) - boost::get<1>(cropOrigin);
 		    	inputImage = inputImage(roi);
 		    }
-			notify(NewFrameEvent::COLOR, inputImage);
+			notify(NewFrameEvent::COLOR, inputImage, sensor);
 		}
 		Camera::update();
 	}
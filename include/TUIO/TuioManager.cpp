@@ -38,13 +38,22 @@ TuioManager::TuioManager()
 }
 
 TuioManager::~TuioManager() {
+	for (std::vector<TuioObject*>::iterator tobj=objectPool.begin(); tobj != objectPool.end(); tobj++)
+		delete (*tobj);
 }
 
 
 TuioObject* TuioManager::addTuioObject(int f_id, float x, float y, float a) {
 	sessionID++;
-	TuioObject *tobj = new TuioObject(currentFrameTime, sessionID, f_id, x, y, a);
-	objectList.push_back(tobj);
+	TuioObject *tobj;
+	if (objectPool.empty()) tobj = new TuioObject(currentFrameTime, sessionID, f_id, x, y, a);
+	else {
+		tobj = objectPool.back();
+		objectPool.pop_back();
+		*tobj = TuioObject(currentFrameTime, sessionID, f_id, x, y, a);
+	}
+	objectIndex[sessionID] = objectList.insert(objectList.end(), tobj);
+	touchedObjects.push_back(sessionID);
 	updateObject = true;
 
 	for (std::list<TuioListener*>::iterator listener=listenerList.begin(); listener != listenerList.end(); listener++)
@@ -58,7 +67,8 @@ TuioObject* TuioManager::addTuioObject(int f_id, float x, float y, float a) {
 
 void TuioManager::addExternalTuioObject(TuioObject *tobj) {
 	if (tobj==NULL) return;
-	objectList.push_back(tobj);
+	objectIndex[tobj->getSessionID()] = objectList.insert(objectList.end(), tobj);
+	touchedObjects.push_back(tobj->getSessionID());
 	updateObject = true;
 
 	for (std::list<TuioListener*>::iterator listener=listenerList.begin(); listener != listenerList.end(); listener++)
@@ -72,6 +82,7 @@ void TuioManager::updateTuioObject(TuioObject *tobj, float x, float y, float a)
 	if (tobj==NULL) return;
 	if (tobj->getTuioTime()==currentFrameTime) return;
 	tobj->update(currentFrameTime,x,y,a);
+	touchedObjects.push_back(tobj->getSessionID());
 	updateObject = true;
 
 	if (tobj->isMoving()) {
@@ -86,6 +97,7 @@ void TuioManager::updateTuioObject(TuioObject *tobj, float x, float y, float a)
 
 void TuioManager::updateExternalTuioObject(TuioObject *tobj) {
 	if (tobj==NULL) return;
+	touchedObjects.push_back(tobj->getSessionID());
 	updateObject = true;
 
 	if (tobj->isMoving()) {
@@ -107,14 +119,22 @@ void TuioManager::removeTuioObject(TuioObject *tobj) {
 	if (verbose)
 		std::cout << "del obj " << tobj->getSymbolID() << " (" << tobj->getSessionID() << ")" << std::endl;
     
-    objectList.remove(tobj);
-    delete tobj;
-    updateObject = true;
+	std::unordered_map<long, std::list<TuioObject*>::iterator>::iterator entry = objectIndex.find(tobj->getSessionID());
+	if (entry != objectIndex.end()) {
+		objectList.erase(entry->second);
+		objectIndex.erase(entry);
+	}
+	objectPool.push_back(tobj);
+	updateObject = true;
 }
 
 void TuioManager::removeExternalTuioObject(TuioObject *tobj) {
 	if (tobj==NULL) return;
-	objectList.remove(tobj);
+	std::unordered_map<long, std::list<TuioObject*>::iterator>::iterator entry = objectIndex.find(tobj->getSessionID());
+	if (entry != objectIndex.end()) {
+		objectList.erase(entry->second);
+		objectIndex.erase(entry);
+	}
 	updateObject = true;
 
 	for (std::list<TuioListener*>::iterator listener=listenerList.begin(); listener != listenerList.end(); listener++)
@@ -142,7 +162,8 @@ TuioCursor* TuioManager::addTuioCursor(float x, float y) {
 	} else maxCursorID = cursorID;	
 	
 	TuioCursor *tcur = new TuioCursor(currentFrameTime, sessionID, cursorID, x, y);
-	cursorList.push_back(tcur);
+	cursorIndex[sessionID] = cursorList.insert(cursorList.end(), tcur);
+	touchedCursors.push_back(sessionID);
 	updateCursor = true;
 
 	for (std::list<TuioListener*>::iterator listener=listenerList.begin(); listener != listenerList.end(); listener++)
@@ -156,7 +177,8 @@ TuioCursor* TuioManager::addTuioCursor(float x, float y) {
 
 void TuioManager::addExternalTuioCursor(TuioCursor *tcur) {
 	if (tcur==NULL) return;
-	cursorList.push_back(tcur);
+	cursorIndex[tcur->getSessionID()] = cursorList.insert(cursorList.end(), tcur);
+	touchedCursors.push_back(tcur->getSessionID());
 	updateCursor = true;
 
 	for (std::list<TuioListener*>::iterator listener=listenerList.begin(); listener != listenerList.end(); listener++)
@@ -170,6 +192,7 @@ void TuioManager::updateTuioCursor(TuioCursor *tcur,float x, float y) {
 	if (tcur==NULL) return;
 	if (tcur->getTuioTime()==currentFrameTime) return;
 	tcur->update(currentFrameTime,x,y);
+	touchedCursors.push_back(tcur->getSessionID());
 	updateCursor = true;
 
 	if (tcur->isMoving()) {	
@@ -184,6 +207,7 @@ void TuioManager::updateTuioCursor(TuioCursor *tcur,float x, float y) {
 
 void TuioManager::updateExternalTuioCursor(TuioCursor *tcur) {
 	if (tcur==NULL) return;
+	touchedCursors.push_back(tcur->getSessionID());
 	updateCursor = true;
 	
 	if (tcur->isMoving()) {	
@@ -199,7 +223,11 @@ void TuioManager::updateExternalTuioCursor(TuioCursor *tcur) {
 void TuioManager::removeTuioCursor(TuioCursor *tcur) {
 	if (tcur==NULL) return;
 
-	cursorList.remove(tcur);
+	std::unordered_map<long, std::list<TuioCursor*>::iterator>::iterator entry = cursorIndex.find(tcur->getSessionID());
+	if (entry != cursorIndex.end()) {
+		cursorList.erase(entry->second);
+		cursorIndex.erase(entry);
+	}
 	tcur->remove(currentFrameTime);
 	updateCursor = true;
 
@@ -243,7 +271,11 @@ void TuioManager::removeTuioCursor(TuioCursor *tcur) {
 
 void TuioManager::removeExternalTuioCursor(TuioCursor *tcur) {
 	if (tcur==NULL) return;
-	cursorList.remove(tcur);
+	std::unordered_map<long, std::list<TuioCursor*>::iterator>::iterator entry = cursorIndex.find(tcur->getSessionID());
+	if (entry != cursorIndex.end()) {
+		cursorList.erase(entry->second);
+		cursorIndex.erase(entry);
+	}
 	updateCursor = true;
 
 	for (std::list<TuioListener*>::iterator listener=listenerList.begin(); listener != listenerList.end(); listener++)
@@ -271,7 +303,8 @@ TuioBlob* TuioManager::addTuioBlob(float x, float y, float a, float w, float h,
 	} else maxBlobID = blobID;	
 	
 	TuioBlob *tblb = new TuioBlob(currentFrameTime, sessionID, blobID, x, y, a, w, h, f);
-	blobList.push_back(tblb);
+	blobIndex[sessionID] = blobList.insert(blobList.end(), tblb);
+	touchedBlobs.push_back(sessionID);
 	updateBlob = true;
 	
 	for (std::list<TuioListener*>::iterator listener=listenerList.begin(); listener != listenerList.end(); listener++)
@@ -285,7 +318,8 @@ TuioBlob* TuioManager::addTuioBlob(float x, float y, float a, float w, float h,
 
 void TuioManager::addExternalTuioBlob(TuioBlob *tblb) {
 	if (tblb==NULL) return;
-	blobList.push_back(tblb);
+	blobIndex[tblb->getSessionID()] = blobList.insert(blobList.end(), tblb);
+	touchedBlobs.push_back(tblb->getSessionID());
 	updateBlob = true;
 	
 	for (std::list<TuioListener*>::iterator listener=listenerList.begin(); listener != listenerList.end(); listener++)
@@ -299,6 +333,7 @@ void TuioManager::updateTuioBlob(TuioBlob *tblb,float x, float y, float a, float
 	if (tblb==NULL) return;
 	if (tblb->getTuioTime()==currentFrameTime) return;
 	tblb->update(currentFrameTime,x,y,a,w,h,f);
+	touchedBlobs.push_back(tblb->getSessionID());
 	updateBlob = true;
 	
 	if (tblb->isMoving()) {	
@@ -313,6 +348,7 @@ void TuioManager::updateTuioBlob(TuioBlob *tblb,float x, float y, float a, float
 
 void TuioManager::updateExternalTuioBlob(TuioBlob *tblb) {
 	if (tblb==NULL) return;
+	touchedBlobs.push_back(tblb->getSessionID());
 	updateBlob = true;
 	
 	if (tblb->isMoving()) {	
@@ -328,7 +364,11 @@ void TuioManager::updateExternalTuioBlob(TuioBlob *tblb) {
 void TuioManager::removeTuioBlob(TuioBlob *tblb) {
 	if (tblb==NULL) return;
 	
-	blobList.remove(tblb);
+	std::unordered_map<long, std::list<TuioBlob*>::iterator>::iterator entry = blobIndex.find(tblb->getSessionID());
+	if (entry != blobIndex.end()) {
+		blobList.erase(entry->second);
+		blobIndex.erase(entry);
+	}
 	tblb->remove(currentFrameTime);
 	updateBlob = true;
 
@@ -373,7 +413,11 @@ void TuioManager::removeTuioBlob(TuioBlob *tblb) {
 
 void TuioManager::removeExternalTuioBlob(TuioBlob *tblb) {
 	if (tblb==NULL) return;
-	blobList.remove(tblb);
+	std::unordered_map<long, std::list<TuioBlob*>::iterator>::iterator entry = blobIndex.find(tblb->getSessionID());
+	if (entry != blobIndex.end()) {
+		blobList.erase(entry->second);
+		blobIndex.erase(entry);
+	}
 	updateBlob = true;
 	
 	for (std::list<TuioListener*>::iterator listener=listenerList.begin(); listener != listenerList.end(); listener++)
@@ -399,6 +443,33 @@ TuioTime TuioManager::getFrameTime() {
 void TuioManager::initFrame(TuioTime ttime) {
 	currentFrameTime = TuioTime(ttime);
 	currentFrame++;
+	touchedObjects.clear();
+	touchedCursors.clear();
+	touchedBlobs.clear();
+}
+
+TuioObject* TuioManager::getTuioObject(long s_id) {
+	lockObjectList();
+	std::unordered_map<long, std::list<TuioObject*>::iterator>::iterator entry = objectIndex.find(s_id);
+	TuioObject *tobj = (entry != objectIndex.end()) ? *(entry->second) : NULL;
+	unlockObjectList();
+	return tobj;
+}
+
+TuioCursor* TuioManager::getTuioCursor(long s_id) {
+	lockCursorList();
+	std::unordered_map<long, std::list<TuioCursor*>::iterator>::iterator entry = cursorIndex.find(s_id);
+	TuioCursor *tcur = (entry != cursorIndex.end()) ? *(entry->second) : NULL;
+	unlockCursorList();
+	return tcur;
+}
+
+TuioBlob* TuioManager::getTuioBlob(long s_id) {
+	lockBlobList();
+	std::unordered_map<long, std::list<TuioBlob*>::iterator>::iterator entry = blobIndex.find(s_id);
+	TuioBlob *tblb = (entry != blobIndex.end()) ? *(entry->second) : NULL;
+	unlockBlobList();
+	return tblb;
 }
 
 void TuioManager::commitFrame() {
@@ -486,8 +557,8 @@ void TuioManager::removeUntouchedStoppedObjects() {
 	while (tuioObject!=objectList.end()) {
 		TuioObject *tobj = (*tuioObject);
 		if ((tobj->getTuioTime()!=currentFrameTime) && (!tobj->isMoving())) {
+			tuioObject++;
 			removeTuioObject(tobj);
-			tuioObject = objectList.begin();
 		} else tuioObject++;
 	}
 }
@@ -533,8 +604,8 @@ void TuioManager::removeUntouchedStoppedCursors() {
 	while (tuioCursor!=cursorList.end()) {
 		TuioCursor *tcur = (*tuioCursor);
 		if ((tcur->getTuioTime()!=currentFrameTime) && (!tcur->isMoving())) {
+			tuioCursor++;
 			removeTuioCursor(tcur);
-			tuioCursor = cursorList.begin();
 		} else tuioCursor++;
 	}	
 }
@@ -579,8 +650,8 @@ void TuioManager::removeUntouchedStoppedBlobs() {
 	while (tuioBlob!=blobList.end()) {
 		TuioBlob *tblb = (*tuioBlob);
 		if ((tblb->getTuioTime()!=currentFrameTime) && (!tblb->isMoving())) {
+			tuioBlob++;
 			removeTuioBlob(tblb);
-			tuioBlob = blobList.begin();
 		} else tuioBlob++;
 	}	
 }
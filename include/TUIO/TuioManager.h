@@ -24,6 +24,8 @@
 #include <iostream>
 #include <list>
 #include <algorithm>
+#include <unordered_map>
+#include <vector>
 
 #define OBJ_MESSAGE_SIZE 108	// setMessage + fseqMessage size
 #define CUR_MESSAGE_SIZE 88
@@ -316,6 +318,30 @@ namespace TUIO {
 		 */
 		void removeUntouchedStoppedBlobs();
 		
+		/**
+		 * Returns the active TuioObject with the given Session ID, using the session index instead of a list scan
+		 *
+		 * @param  s_id  the Session ID of the TuioObject to return
+		 * @return  the active TuioObject with the given Session ID or NULL
+		 */
+		TuioObject* getTuioObject(long s_id);
+		
+		/**
+		 * Returns the active TuioCursor with the given Session ID, using the session index instead of a list scan
+		 *
+		 * @param  s_id  the Session ID of the TuioCursor to return
+		 * @return  the active TuioCursor with the given Session ID or NULL
+		 */
+		TuioCursor* getTuioCursor(long s_id);
+		
+		/**
+		 * Returns the active TuioBlob with the given Session ID, using the session index instead of a list scan
+		 *
+		 * @param  s_id  the Session ID of the TuioBlob to return
+		 * @return  the active TuioBlob with the given Session ID or NULL
+		 */
+		TuioBlob* getTuioBlob(long s_id);
+		
 		/**
 		 * Returns the TuioObject closest to the provided coordinates
 		 * or NULL if there isn't any active TuioObject
@@ -363,6 +389,16 @@ namespace TUIO {
 		void resetTuioBlobs();		
 		
 	protected:
+		std::unordered_map<long, std::list<TuioObject*>::iterator> objectIndex;
+		std::unordered_map<long, std::list<TuioCursor*>::iterator> cursorIndex;
+		std::unordered_map<long, std::list<TuioBlob*>::iterator> blobIndex;
+
+		std::vector<long> touchedObjects;
+		std::vector<long> touchedCursors;
+		std::vector<long> touchedBlobs;
+
+		std::vector<TuioObject*> objectPool;
+
 		std::list<TuioCursor*> freeCursorList;
 		std::list<TuioCursor*> freeCursorBuffer;
 
@@ -18,10 +18,41 @@
 
 #include "TuioServer.h"
 #include "UdpSender.h"
+#include <cstring>
 
 using namespace TUIO;
 using namespace osc;
 
+#define OBJ_ARGUMENTS_SIZE 40	// session and symbol id, then eight floats
+#define CUR_ARGUMENTS_SIZE 24	// session id, then five floats
+#define BLB_ARGUMENTS_SIZE 48	// session id, then eleven floats
+
+static inline char *putInt32(char *p, int32 x) {
+	uint32 u = (uint32)x;
+	p[0] = (char)(u >> 24);
+	p[1] = (char)(u >> 16);
+	p[2] = (char)(u >> 8);
+	p[3] = (char)u;
+	return p + 4;
+}
+
+static inline char *putFloat(char *p, float x) {
+	int32 i;
+	std::memcpy(&i, &x, 4);
+	return putInt32(p, i);
+}
+
+// encodes a set message with zeroed arguments, which addObjectMessage and its relatives copy and patch
+static std::string encodeTemplate(const char *address, int ints, int floats) {
+	char buffer[MAX_UDP_SIZE];
+	osc::OutboundPacketStream packet(buffer, MAX_UDP_SIZE);
+	packet << osc::BeginMessage(address) << "set";
+	for (int i = 0; i < ints; i++) packet << (int32)0;
+	for (int i = 0; i < floats; i++) packet << 0.0f;
+	packet << osc::EndMessage;
+	return std::string(packet.Data(), packet.Size());
+}
+
 TuioServer::TuioServer() 
 	:local_sender			(true)
 	,full_update			(false)	
@@ -70,6 +101,10 @@ void TuioServer::initialize() {
 	fullBuffer = new char[size];
 	fullPacket = new osc::OutboundPacketStream(oscBuffer,size);
 	
+	objectTemplate = encodeTemplate("/tuio/2Dobj", 2, 8);
+	cursorTemplate = encodeTemplate("/tuio/2Dcur", 1, 5);
+	blobTemplate = encodeTemplate("/tuio/2Dblb", 1, 11);
+	
 	objectUpdateTime = TuioTime(currentFrameTime);
 	cursorUpdateTime = TuioTime(currentFrameTime);
 	blobUpdateTime = TuioTime(currentFrameTime);
@@ -187,15 +222,31 @@ void TuioServer::commitFrame() {
 		
 	if(updateObject) {
 		startObjectBundle();
-		for (std::list<TuioObject*>::iterator  tuioObject = objectList.begin(); tuioObject!=objectList.end(); tuioObject++) {
-			
-			// start a new packet if we exceed the packet capacity
-			if ((oscPacket->Capacity()-oscPacket->Size())<OBJ_MESSAGE_SIZE) {
-				sendObjectBundle(currentFrame);
-				startObjectBundle();
+		if (full_update) {
+			for (std::list<TuioObject*>::iterator  tuioObject = objectList.begin(); tuioObject!=objectList.end(); tuioObject++) {
+				
+				// start a new packet if we exceed the packet capacity
+				if ((oscPacket->Capacity()-oscPacket->Size())<OBJ_MESSAGE_SIZE) {
+					sendObjectBundle(currentFrame);
+					startObjectBundle();
+				}
+				addObjectMessage(oscPacket, *tuioObject);
+			}
+		} else {
+			// only the objects touched in this frame need a set message
+			std::sort(touchedObjects.begin(), touchedObjects.end());
+			touchedObjects.erase(std::unique(touchedObjects.begin(), touchedObjects.end()), touchedObjects.end());
+			for (std::vector<long>::iterator s_id = touchedObjects.begin(); s_id != touchedObjects.end(); s_id++) {
+				std::unordered_map<long, std::list<TuioObject*>::iterator>::iterator entry = objectIndex.find(*s_id);
+				if ((entry == objectIndex.end()) || ((*(entry->second))->getTuioTime()!=currentFrameTime)) continue;
+				
+				// start a new packet if we exceed the packet capacity
+				if ((oscPacket->Capacity()-oscPacket->Size())<OBJ_MESSAGE_SIZE) {
+					sendObjectBundle(currentFrame);
+					startObjectBundle();
+				}
+				addObjectMessage(oscPacket, *(entry->second));
 			}
-			TuioObject *tobj = (*tuioObject);
-			if  ((full_update) || (tobj->getTuioTime()==currentFrameTime)) addObjectMessage(tobj);
 		}
 		objectUpdateTime = TuioTime(currentFrameTime);
 		sendObjectBundle(currentFrame);
@@ -212,7 +263,7 @@ void TuioServer::commitFrame() {
 						sendObjectBundle(currentFrame);
 						startObjectBundle();
 					}
-					addObjectMessage(*tuioObject);
+					addObjectMessage(oscPacket, *tuioObject);
 				}
 			}
 			sendObjectBundle(currentFrame);
@@ -222,15 +273,31 @@ void TuioServer::commitFrame() {
 
 	if(updateCursor) {
 		startCursorBundle();
-		for (std::list<TuioCursor*>::iterator tuioCursor = cursorList.begin(); tuioCursor!=cursorList.end(); tuioCursor++) {
-			
-			// start a new packet if we exceed the packet capacity
-			if ((oscPacket->Capacity()-oscPacket->Size())<CUR_MESSAGE_SIZE) {
-				sendCursorBundle(currentFrame);
-				startCursorBundle();
+		if (full_update) {
+			for (std::list<TuioCursor*>::iterator tuioCursor = cursorList.begin(); tuioCursor!=cursorList.end(); tuioCursor++) {
+				
+				// start a new packet if we exceed the packet capacity
+				if ((oscPacket->Capacity()-oscPacket->Size())<CUR_MESSAGE_SIZE) {
+					sendCursorBundle(currentFrame);
+					startCursorBundle();
+				}
+				addCursorMessage(oscPacket, *tuioCursor);
+			}
+		} else {
+			// only the cursors touched in this frame need a set message
+			std::sort(touchedCursors.begin(), touchedCursors.end());
+			touchedCursors.erase(std::unique(touchedCursors.begin(), touchedCursors.end()), touchedCursors.end());
+			for (std::vector<long>::iterator s_id = touchedCursors.begin(); s_id != touchedCursors.end(); s_id++) {
+				std::unordered_map<long, std::list<TuioCursor*>::iterator>::iterator entry = cursorIndex.find(*s_id);
+				if ((entry == cursorIndex.end()) || ((*(entry->second))->getTuioTime()!=currentFrameTime)) continue;
+				
+				// start a new packet if we exceed the packet capacity
+				if ((oscPacket->Capacity()-oscPacket->Size())<CUR_MESSAGE_SIZE) {
+					sendCursorBundle(currentFrame);
+					startCursorBundle();
+				}
+				addCursorMessage(oscPacket, *(entry->second));
 			}
-			TuioCursor *tcur = (*tuioCursor);
-			if ((full_update) || (tcur->getTuioTime()==currentFrameTime)) addCursorMessage(tcur);				
 		}
 		cursorUpdateTime = TuioTime(currentFrameTime);
 		sendCursorBundle(currentFrame);
@@ -246,7 +313,7 @@ void TuioServer::commitFrame() {
 						sendCursorBundle(currentFrame);
 						startCursorBundle();
 					}
-					addCursorMessage(*tuioCursor);
+					addCursorMessage(oscPacket, *tuioCursor);
 				}
 			}
 			sendCursorBundle(currentFrame);
@@ -256,14 +323,29 @@ void TuioServer::commitFrame() {
 	
 	if(updateBlob) {
 		startBlobBundle();
-		for (std::list<TuioBlob*>::iterator tuioBlob =blobList.begin(); tuioBlob!=blobList.end(); tuioBlob++) {
-			// start a new packet if we exceed the packet capacity
-			if ((oscPacket->Capacity()-oscPacket->Size())<BLB_MESSAGE_SIZE) {
-				sendBlobBundle(currentFrame);
-				startBlobBundle();
+		if (full_update) {
+			for (std::list<TuioBlob*>::iterator tuioBlob =blobList.begin(); tuioBlob!=blobList.end(); tuioBlob++) {
+				// start a new packet if we exceed the packet capacity
+				if ((oscPacket->Capacity()-oscPacket->Size())<BLB_MESSAGE_SIZE) {
+					sendBlobBundle(currentFrame);
+					startBlobBundle();
+				}
+				addBlobMessage(oscPacket, *tuioBlob);
+			}
+		} else {
+			// only the blobs touched in this frame need a set message
+			std::sort(touchedBlobs.begin(), touchedBlobs.end());
+			touchedBlobs.erase(std::unique(touchedBlobs.begin(), touchedBlobs.end()), touchedBlobs.end());
+			for (std::vector<long>::iterator s_id = touchedBlobs.begin(); s_id != touchedBlobs.end(); s_id++) {
+				std::unordered_map<long, std::list<TuioBlob*>::iterator>::iterator entry = blobIndex.find(*s_id);
+				if ((entry == blobIndex.end()) || ((*(entry->second))->getTuioTime()!=currentFrameTime)) continue;
+				// start a new packet if we exceed the packet capacity
+				if ((oscPacket->Capacity()-oscPacket->Size())<BLB_MESSAGE_SIZE) {
+					sendBlobBundle(currentFrame);
+					startBlobBundle();
+				}
+				addBlobMessage(oscPacket, *(entry->second));
 			}
-			TuioBlob *tblb = (*tuioBlob);
-			if ((full_update) || (tblb->getTuioTime()==currentFrameTime)) addBlobMessage(tblb);		
 		}
 		blobUpdateTime = TuioTime(currentFrameTime);
 		sendBlobBundle(currentFrame);
@@ -280,7 +362,7 @@ void TuioServer::commitFrame() {
 						sendBlobBundle(currentFrame);
 						startBlobBundle();
 					}
-					addBlobMessage(*tuioBlob);
+					addBlobMessage(oscPacket, *tuioBlob);
 				}
 			}
 			sendBlobBundle(currentFrame);
@@ -310,7 +392,7 @@ void TuioServer::startCursorBundle() {
 	(*oscPacket) << osc::EndMessage;	
 }
 
-void TuioServer::addCursorMessage(TuioCursor *tcur) {
+void TuioServer::addCursorMessage(osc::OutboundPacketStream *packet, TuioCursor *tcur) {
 
 	float xpos = tcur->getX();
 	float xvel = tcur->getXSpeed();
@@ -325,10 +407,13 @@ void TuioServer::addCursorMessage(TuioCursor *tcur) {
 		yvel = -1 * yvel;
 	}
 
-	(*oscPacket) << osc::BeginMessage( "/tuio/2Dcur") << "set";
-	(*oscPacket) << (int32)(tcur->getSessionID()) << xpos << ypos;
-	(*oscPacket) << xvel << yvel << tcur->getMotionAccel();	
-	(*oscPacket) << osc::EndMessage;
+	char *args = packet->AppendMessage(cursorTemplate.data(), cursorTemplate.size()) + cursorTemplate.size() - CUR_ARGUMENTS_SIZE;
+	args = putInt32(args, (int32)(tcur->getSessionID()));
+	args = putFloat(args, xpos);
+	args = putFloat(args, ypos);
+	args = putFloat(args, xvel);
+	args = putFloat(args, yvel);
+	putFloat(args, tcur->getMotionAccel());
 }
 
 void TuioServer::sendCursorBundle(long fseq) {
@@ -358,7 +443,7 @@ void TuioServer::startObjectBundle() {
 	(*oscPacket) << osc::EndMessage;
 }
 
-void TuioServer::addObjectMessage(TuioObject *tobj) {
+void TuioServer::addObjectMessage(osc::OutboundPacketStream *packet, TuioObject *tobj) {
 	
 	float xpos = tobj->getX();
 	float xvel = tobj->getXSpeed();
@@ -379,10 +464,17 @@ void TuioServer::addObjectMessage(TuioObject *tobj) {
 		rvel = -1 * rvel;
 	}
 	
-	(*oscPacket) << osc::BeginMessage( "/tuio/2Dobj") << "set";
-	(*oscPacket) << (int32)(tobj->getSessionID()) << tobj->getSymbolID() << xpos << ypos << angle;
-	(*oscPacket) << xvel << yvel << rvel << tobj->getMotionAccel() << tobj->getRotationAccel();	
-	(*oscPacket) << osc::EndMessage;
+	char *args = packet->AppendMessage(objectTemplate.data(), objectTemplate.size()) + objectTemplate.size() - OBJ_ARGUMENTS_SIZE;
+	args = putInt32(args, (int32)(tobj->getSessionID()));
+	args = putInt32(args, tobj->getSymbolID());
+	args = putFloat(args, xpos);
+	args = putFloat(args, ypos);
+	args = putFloat(args, angle);
+	args = putFloat(args, xvel);
+	args = putFloat(args, yvel);
+	args = putFloat(args, rvel);
+	args = putFloat(args, tobj->getMotionAccel());
+	putFloat(args, tobj->getRotationAccel());
 }
 
 void TuioServer::sendObjectBundle(long fseq) {
@@ -413,7 +505,7 @@ void TuioServer::startBlobBundle() {
 	(*oscPacket) << osc::EndMessage;	
 }
 
-void TuioServer::addBlobMessage(TuioBlob *tblb) {
+void TuioServer::addBlobMessage(osc::OutboundPacketStream *packet, TuioBlob *tblb) {
 	
 	float xpos = tblb->getX();
 	float xvel = tblb->getXSpeed();
@@ -434,10 +526,19 @@ void TuioServer::addBlobMessage(TuioBlob *tblb) {
 		rvel = -1 * rvel;
 	}
 	
-	(*oscPacket) << osc::BeginMessage( "/tuio/2Dblb") << "set";
-	(*oscPacket) << (int32)(tblb->getSessionID()) << xpos << ypos << angle << tblb->getWidth() << tblb->getHeight() << tblb->getArea();
-	(*oscPacket) << xvel << yvel  << rvel << tblb->getMotionAccel()  << tblb->getRotationAccel();	
-	(*oscPacket) << osc::EndMessage;
+	char *args = packet->AppendMessage(blobTemplate.data(), blobTemplate.size()) + blobTemplate.size() - BLB_ARGUMENTS_SIZE;
+	args = putInt32(args, (int32)(tblb->getSessionID()));
+	args = putFloat(args, xpos);
+	args = putFloat(args, ypos);
+	args = putFloat(args, angle);
+	args = putFloat(args, tblb->getWidth());
+	args = putFloat(args, tblb->getHeight());
+	args = putFloat(args, tblb->getArea());
+	args = putFloat(args, xvel);
+	args = putFloat(args, yvel);
+	args = putFloat(args, rvel);
+	args = putFloat(args, tblb->getMotionAccel());
+	putFloat(args, tblb->getRotationAccel());
 }
 
 void TuioServer::sendBlobBundle(long fseq) {
@@ -481,24 +582,8 @@ void TuioServer::sendFullMessages() {
 			(*fullPacket) << osc::EndMessage;				
 		}
 		
-		float xpos = (*tuioCursor)->getX();
-		float xvel = (*tuioCursor)->getXSpeed();
-		if (invert_x) {
-			xpos = 1 - xpos;
-			xvel = -1 * xvel;
-		}
-		float ypos = (*tuioCursor)->getY();
-		float yvel = (*tuioCursor)->getYSpeed();
-		if (invert_y) {
-			ypos = 1 - ypos;
-			yvel = -1 * yvel;
-		}
-		
 		// add the actual cursor set message
-		(*fullPacket) << osc::BeginMessage( "/tuio/2Dcur") << "set";
-		(*fullPacket) << (int32)((*tuioCursor)->getSessionID()) << xpos << ypos;
-		(*fullPacket) << xvel << yvel <<(*tuioCursor)->getMotionAccel();	
-		(*fullPacket) << osc::EndMessage;	
+		addCursorMessage(fullPacket, *tuioCursor);
 	}
 	
 	// add the immediate fseq message and send the cursor packet
@@ -536,30 +621,8 @@ void TuioServer::sendFullMessages() {
 			(*fullPacket) << osc::EndMessage;	
 		}
 		
-		float xpos = (*tuioObject)->getX();
-		float xvel = (*tuioObject)->getXSpeed();
-		if (invert_x) {
-			xpos = 1 - xpos;
-			xvel = -1 * xvel;
-		}
-		float ypos = (*tuioObject)->getY();
-		float yvel = (*tuioObject)->getYSpeed();
-		if (invert_y) {
-			ypos = 1 - ypos;
-			yvel = -1 * yvel;
-		}
-		float angle = (*tuioObject)->getAngle();
-		float rvel = (*tuioObject)->getRotationSpeed();
-		if (invert_a) {
-			angle =  2.0f*(float)M_PI - angle;
-			rvel = -1 * rvel;
-		}
-		
 		// add the actual object set message
-		(*fullPacket) << osc::BeginMessage( "/tuio/2Dobj") << "set";
-		(*fullPacket) << (int32)((*tuioObject)->getSessionID()) << (*tuioObject)->getSymbolID() << xpos << ypos << angle;
-		(*fullPacket) << xvel << yvel << rvel << (*tuioObject)->getMotionAccel() << (*tuioObject)->getRotationAccel();	
-		(*fullPacket) << osc::EndMessage;
+		addObjectMessage(fullPacket, *tuioObject);
 		
 	}
 	// add the immediate fseq message and send the object packet
@@ -597,30 +660,8 @@ void TuioServer::sendFullMessages() {
 			(*fullPacket) << osc::EndMessage;	
 		}
 		
-		float xpos = (*tuioBlob)->getX();
-		float xvel = (*tuioBlob)->getXSpeed();
-		if (invert_x) {
-			xpos = 1 - xpos;
-			xvel = -1 * xvel;
-		}
-		float ypos = (*tuioBlob)->getY();
-		float yvel = (*tuioBlob)->getYSpeed();
-		if (invert_y) {
-			ypos = 1 - ypos;
-			yvel = -1 * yvel;
-		}
-		float angle = (*tuioBlob)->getAngle();
-		float rvel = (*tuioBlob)->getRotationSpeed();
-		if (invert_a) {
-			angle = 2.0f*(float)M_PI - angle;
-			rvel = -1 * rvel;
-		}		
-		
 		// add the actual blob set message
-		(*fullPacket) << osc::BeginMessage( "/tuio/2Dblb") << "set";
-		(*fullPacket) << (int32)((*tuioBlob)->getSessionID()) << xpos << ypos  << angle << (*tuioBlob)->getWidth() << (*tuioBlob)->getHeight() << (*tuioBlob)->getArea();
-		(*fullPacket) << xvel << yvel << rvel << (*tuioBlob)->getMotionAccel() << (*tuioBlob)->getRotationAccel();	
-		(*fullPacket) << osc::EndMessage;
+		addBlobMessage(fullPacket, *tuioBlob);
 		
 	}
 	// add the immediate fseq message and send the blob packet
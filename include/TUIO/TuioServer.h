@@ -22,6 +22,7 @@
 #include "TuioManager.h"
 #include "UdpSender.h"
 #include <iostream>
+#include <string>
 #include <vector>
 #include <stdio.h>
 #ifndef WIN32
@@ -205,18 +206,21 @@ namespace TUIO {
 		osc::OutboundPacketStream  *fullPacket;
 		char *fullBuffer; 
 		
+		// pre-encoded set messages of each profile, see addObjectMessage
+		std::string objectTemplate, cursorTemplate, blobTemplate;
+		
 		void startObjectBundle();
-		void addObjectMessage(TuioObject *tobj);
+		void addObjectMessage(osc::OutboundPacketStream *packet, TuioObject *tobj);
 		void sendObjectBundle(long fseq);
 		void sendEmptyObjectBundle();
 
 		void startCursorBundle();
-		void addCursorMessage(TuioCursor *tcur);
+		void addCursorMessage(osc::OutboundPacketStream *packet, TuioCursor *tcur);
 		void sendCursorBundle(long fseq);
 		void sendEmptyCursorBundle();
 
 		void startBlobBundle();
-		void addBlobMessage(TuioBlob *tblb);
+		void addBlobMessage(osc::OutboundPacketStream *packet, TuioBlob *tblb);
 		void sendBlobBundle(long fseq);
 		void sendEmptyBlobBundle();
 		
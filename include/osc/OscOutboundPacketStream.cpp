@@ -678,6 +678,31 @@ OutboundPacketStream& OutboundPacketStream::operator<<( const ArrayTerminator& r
     return *this;
 }
 
+char *OutboundPacketStream::AppendMessage( const char *message, std::size_t size )
+{
+    if( IsMessageInProgress() )
+        throw MessageInProgressException();
+
+    assert( (size & 0x3) == 0 );
+
+    std::size_t required = Size() + ((ElementSizeSlotRequired())?4:0) + size;
+
+    if( required > Capacity() )
+        throw OutOfBufferMemoryException();
+
+    if( ElementSizeSlotRequired() ){
+        FromUInt32( messageCursor_, (uint32)size );
+        messageCursor_ += 4;
+    }
+
+    char *result = messageCursor_;
+    std::memcpy( messageCursor_, message, size );
+    messageCursor_ += size;
+    argumentCurrent_ = messageCursor_;
+
+    return result;
+}
+
 } // namespace osc
 
 
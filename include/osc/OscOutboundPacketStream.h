@@ -124,6 +124,11 @@ public:
     OutboundPacketStream& operator<<( const ArrayInitiator& rhs );
     OutboundPacketStream& operator<<( const ArrayTerminator& rhs );
 
+    // appends a complete, already encoded message (size must be a multiple
+    // of 4) and returns a pointer to its copy, so that arguments at known
+    // offsets can be patched in place.
+    char *AppendMessage( const char *message, std::size_t size );
+
 private:
 
     char *BeginElement( char *beginPtr );
@@ -65,6 +65,16 @@ public:
         return make_pair(make_error_code(error::disabled),std::string());
     }
 
+    /// Initialize state
+    /**
+     * The disabled extension has no state to initialize.
+     *
+     * @return Error or status code
+     */
+    lib::error_code init() {
+        return make_error_code(error::disabled);
+    }
+
     /// Returns true if the extension is capable of providing
     /// permessage_deflate functionality
     bool is_implemented() const {
@@ -125,10 +125,14 @@ public:
                         //std::cout << "permessage-compress negotiation failed: "
                         //          << neg_ret.first.message() << std::endl;
                     } else {
+                        lib::error_code ec = m_permessage_deflate.init();
+                        if (ec) {
+                            continue;
+                        }
                         // Note: this list will need commas if WebSocket++ ever
                         // supports more than one extension
                         ret.second += neg_ret.second;
-                        continue;
+                        break;
                     }
                 }
             }
@@ -551,25 +555,27 @@ public:
                           && in->get_compressed();
         bool fin = in->get_fin();
 
-        // generate header
-        frame::basic_header h(op,i.size(),fin,masked,compressed);
-
         if (masked) {
             // Generate masking key.
             key.i = m_rng();
-
-            frame::extended_header e(i.size(),key.i);
-            out->set_header(frame::prepare_header(h,e));
         } else {
-            frame::extended_header e(i.size());
-            out->set_header(frame::prepare_header(h,e));
             key.i = 0;
         }
 
         // prepare payload
         if (compressed) {
             // compress and store in o after header.
-            m_permessage_deflate.compress(i,o);
+            lib::error_code ec = m_permessage_deflate.compress(i,o);
+
+            if (ec) {
+                return ec;
+            }
+
+            // Strip the trailing 0x00 0x00 0xff 0xff left by the sync flush,
+            // as required by RFC 7692 section 7.2.1.
+            if (o.size() >= 4) {
+                o.resize(o.size()-4);
+            }
 
             // mask in place if necessary
             if (masked) {
@@ -589,6 +595,17 @@ public:
             }
         }
 
+        // generate header once the final payload size is known
+        frame::basic_header h(op,o.size(),fin,masked,compressed);
+
+        if (masked) {
+            frame::extended_header e(o.size(),key.i);
+            out->set_header(frame::prepare_header(h,e));
+        } else {
+            frame::extended_header e(o.size());
+            out->set_header(frame::prepare_header(h,e));
+        }
+
         out->set_prepared(true);
         out->set_opcode(op);
 
@@ -736,8 +753,12 @@ protected:
             // Decompress current buffer into the message buffer
             m_permessage_deflate.decompress(buf,len,out);
 
-            // get the length of the newly uncompressed output
-            offset = out.size() - offset;
+            // Restore the 0x00 0x00 0xff 0xff tail stripped by the sender
+            // once the last bytes of the final frame are in.
+            if (len == m_bytes_needed && frame::get_fin(m_basic_header)) {
+                static uint8_t const tail[4] = {0x00, 0x00, 0xff, 0xff};
+                m_permessage_deflate.decompress(tail,4,out);
+            }
         } else {
             // No compression, straight copy
             out.append(reinterpret_cast<char *>(buf),len);
@@ -0,0 +1,266 @@
+#ifndef FRAMESTREAM_CC
+#define FRAMESTREAM_CC
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+#include <opencv2/opencv.hpp>
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/server.hpp>
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+
+#include <Camera.hpp>
+#include <publishers/WebSocket.cc>
+
+using namespace SPRITS;
+
+#define FRAME_MAGIC 0x46525053 // "SPRF" as a little-endian uint32.
+#define FRAME_VERSION 1
+#define FRAME_COLOR 1 // Payload is a JPEG image.
+#define FRAME_DEPTH 2 // Payload is a zlib stream of zigzag-coded 16-bit deltas, see encodeDepth.
+#define FRAME_RATE 10.0 // Frames per second sent to viewers, for each of the color and depth streams.
+#define FRAME_SCALE 0.5 // Downscaling applied to both streams before encoding.
+#define FRAME_QUALITY 70 // JPEG quality of the color stream.
+#define FRAME_ENCODERS 2 // Threads encoding frames, running only while at least one viewer is connected.
+#define FRAME_HIGH_WATERMARK (4 << 20) // Bytes buffered by websocketpp above which a viewer skips frames.
+
+// Streams downscaled camera frames to WebSocket viewers. Viewers connect to / for both streams, or
+// to /color or /depth for one of them. Every binary message starts with a header (uint32 magic,
+// uint8 version, uint8 kind, uint16 width, uint16 height, 2 padding bytes, uint64 timestamp in
+// microseconds, uint32 frame number, all little-endian) followed by the encoded frame.
+class FrameStreamPublisher : public CameraObserver<std::tuple<double, double, double>>
+{
+private:
+	typedef websocketpp::server<websocketpp::config::asio> server_type;
+
+	struct Viewer
+	{
+		bool color, depth;
+	};
+
+	struct Stream
+	{
+		std::atomic<int> viewers;
+		std::atomic<bool> busy;
+		std::chrono::steady_clock::time_point next;
+		uint32_t frames;
+		Stream() : viewers(0), busy(false), frames(0) { }
+	};
+
+	// Encoder threads of one watched period. A retired pool finishes the frames already queued on its
+	// own threads and is joined once they are done, so no WebSocket handler ever waits for an encode.
+	struct Pool
+	{
+		boost::asio::io_service service;
+		std::unique_ptr<boost::asio::io_service::work> work;
+		std::vector<std::thread> threads;
+		std::atomic<std::size_t> running;
+
+		Pool(std::size_t count) : work(new boost::asio::io_service::work(service)), running(count)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+				threads.push_back(std::thread([this] { service.run(); --running; }));
+		}
+
+		~Pool()
+		{
+			work.reset();
+			for (auto& thread : threads)
+				thread.join();
+		}
+	};
+
+	server_type server_;
+	std::thread thread_;
+	std::mutex mutex_, poolMutex_;
+	std::map<websocketpp::connection_hdl, Viewer, std::owner_less<websocketpp::connection_hdl>> viewers_;
+	Stream color_, depth_;
+	std::chrono::steady_clock::duration period_;
+	double scale_;
+	std::unique_ptr<Pool> pool_;
+	std::vector<std::unique_ptr<Pool>> retired_;
+
+	static std::string header(uint8_t kind, const cv::Mat& frame, uint32_t number)
+	{
+		std::string out;
+		BinaryWriter(out).value(static_cast<uint32_t>(FRAME_MAGIC)).value(static_cast<uint8_t>(FRAME_VERSION)).value(kind).value(static_cast<uint16_t>(frame.cols)).value(static_cast<uint16_t>(frame.rows)).pad(2).value(BinaryWriter::now()).value(number);
+		return out;
+	}
+
+	static std::string encodeColor(const cv::Mat& frame, uint32_t number)
+	{
+		std::vector<uint8_t> jpeg;
+		cv::imencode(".jpg", frame, jpeg, std::vector<int> { cv::IMWRITE_JPEG_QUALITY, FRAME_QUALITY });
+		std::string out = header(FRAME_COLOR, frame, number);
+		out.append(jpeg.begin(), jpeg.end());
+		return out;
+	}
+
+	// Each depth sample is predicted by its left neighbour (the one above for the first column), the
+	// wrapping 16-bit difference is zigzag-coded so small steps of either sign stay small, and the
+	// little-endian result is compressed with zlib's run-length strategy, which suits the long runs
+	// of flat or invalid depth.
+	static std::string encodeDepth(const cv::Mat& frame, uint32_t number)
+	{
+		std::vector<uint8_t> deltas(frame.total() * 2);
+		uint8_t* out = deltas.data();
+		for (int y = 0; y < frame.rows; ++y)
+		{
+			const uint16_t* row = frame.ptr<uint16_t>(y);
+			uint16_t previous = (y > 0) ? *frame.ptr<uint16_t>(y - 1) : 0;
+			for (int x = 0; x < frame.cols; ++x)
+			{
+				int16_t delta = static_cast<int16_t>(row[x] - previous);
+				uint16_t zigzag = static_cast<uint16_t>((delta << 1) ^ (delta >> 15));
+				*out++ = zigzag & 0xff;
+				*out++ = zigzag >> 8;
+				previous = row[x];
+			}
+		}
+		std::string result = header(FRAME_DEPTH, frame, number);
+		std::size_t offset = result.size();
+		z_stream zs = z_stream();
+		deflateInit2(&zs, 1, Z_DEFLATED, 15, 8, Z_RLE);
+		result.resize(offset + deflateBound(&zs, deltas.size()));
+		zs.next_in = deltas.data();
+		zs.avail_in = deltas.size();
+		zs.next_out = reinterpret_cast<Bytef*>(&result[offset]);
+		zs.avail_out = result.size() - offset;
+		deflate(&zs, Z_FINISH);
+		result.resize(offset + zs.total_out);
+		deflateEnd(&zs);
+		return result;
+	}
+
+	void broadcast(bool depth, const std::string& message)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (const auto& it : viewers_)
+		{
+			if (!(depth ? it.second.depth : it.second.color))
+				continue;
+			websocketpp::lib::error_code ec;
+			server_type::connection_ptr con = server_.get_con_from_hdl(it.first, ec);
+			if (con && (con->get_buffered_amount() <= FRAME_HIGH_WATERMARK))
+				con->send(message, websocketpp::frame::opcode::binary);
+		}
+	}
+
+	// Encoders only run while someone watches, the last viewer leaving lets them finish and exit.
+	// Called from the WebSocket handlers, so it only joins retired pools whose threads are done.
+	void balance()
+	{
+		std::lock_guard<std::mutex> lock(poolMutex_);
+		retired_.erase(std::remove_if(retired_.begin(), retired_.end(), [](const std::unique_ptr<Pool>& pool) { return pool->running == 0; }), retired_.end());
+		bool watched = (color_.viewers + depth_.viewers) > 0;
+		if (watched && !pool_)
+		{
+			pool_.reset(new Pool(FRAME_ENCODERS));
+			spdlog::get("console")->debug("Frame encoders started.");
+		} else if (!watched && pool_)
+		{
+			pool_->work.reset();
+			retired_.push_back(std::move(pool_));
+			spdlog::get("console")->debug("Frame encoders stopped.");
+		}
+	}
+
+	void open(websocketpp::connection_hdl hdl)
+	{
+		std::string resource = server_.get_con_from_hdl(hdl)->get_resource();
+		resource = resource.substr(0, resource.find('?'));
+		Viewer viewer = { resource != "/depth", resource != "/color" };
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			viewers_[hdl] = viewer;
+			color_.viewers += viewer.color;
+			depth_.viewers += viewer.depth;
+		}
+		balance();
+	}
+
+	void close(websocketpp::connection_hdl hdl)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			auto it = viewers_.find(hdl);
+			if (it == viewers_.end())
+				return;
+			color_.viewers -= it->second.color;
+			depth_.viewers -= it->second.depth;
+			viewers_.erase(it);
+		}
+		balance();
+	}
+public:
+	FrameStreamPublisher(Camera *cam, Space<std::tuple<double, double, double>> *spc, int port, double rate = FRAME_RATE, double scale = FRAME_SCALE) : CameraObserver<std::tuple<double, double, double>>(cam, spc, NewFrameEvent::COLOR, NewFrameEvent::DEPTH), period_(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1 / rate))), scale_(scale)
+	{
+		spdlog::get("console")->info("Starting frame streaming server...");
+		server_.clear_access_channels(websocketpp::log::alevel::all);
+		server_.init_asio();
+		server_.set_reuse_addr(true);
+		server_.set_open_handler(std::bind(&FrameStreamPublisher::open, this, std::placeholders::_1));
+		server_.set_close_handler(std::bind(&FrameStreamPublisher::close, this, std::placeholders::_1));
+		server_.listen(port);
+		server_.start_accept();
+		thread_ = std::thread([this] { server_.run(); });
+		spdlog::get("console")->info("Frame streaming server started successfully on port {}!", port);
+	}
+
+	~FrameStreamPublisher()
+	{
+		spdlog::get("console")->info("Stopping frame streaming server...");
+		for (auto&& con : con_ | boost::adaptors::map_values) con.disconnect();
+		server_.stop();
+		thread_.join();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			viewers_.clear();
+			color_.viewers = depth_.viewers = 0;
+		}
+		balance();
+		{
+			std::lock_guard<std::mutex> lock(poolMutex_);
+			retired_.clear();
+		}
+		spdlog::get("console")->info("Frame streaming server stopped successfully!");
+	}
+
+	// Runs on the camera thread and never waits: without viewers, while the previous frame of the stream
+	// is still being encoded, or when the rate is exceeded, a frame costs a couple of atomic loads.
+	void fire(const NewFrameEvent& event, const cv::Mat& frame)
+	{
+		bool depth = (event == NewFrameEvent::DEPTH);
+		Stream& stream = depth ? depth_ : color_;
+		if ((stream.viewers == 0) || stream.busy)
+			return;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now < stream.next)
+			return;
+		std::unique_lock<std::mutex> lock(poolMutex_, std::try_to_lock);
+		if (!lock || !pool_)
+			return;
+		stream.next = now + period_;
+		stream.busy = true;
+		cv::Mat small;
+		cv::resize(frame, small, cv::Size(), scale_, scale_, depth ? cv::INTER_NEAREST : cv::INTER_AREA);
+		uint32_t number = ++stream.frames;
+		pool_->service.post([this, depth, small, number] {
+			TRACE_SCOPE("FrameStreamPublisher::encode");
+			broadcast(depth, depth ? encodeDepth(small, number) : encodeColor(small, number));
+			(depth ? depth_ : color_).busy = false;
+		});
+	}
+};
+
+#endif
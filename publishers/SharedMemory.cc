@@ -0,0 +1,142 @@
+#ifndef SHAREDMEMORY_CC
+#define SHAREDMEMORY_CC
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+#include <Space.hpp>
+#include <publishers/SharedMemory.hpp>
+
+using namespace SPRITS;
+
+class SharedMemoryPublisher : public SpaceObserver<std::tuple<double, double, double>>
+{
+private:
+	std::string name_;
+	ShmRegion* region_;
+	std::unordered_map<int, std::size_t> index_;
+	std::vector<ShmElement> elements_;
+	uint64_t frame_;
+	bool truncated_;
+public:
+	SharedMemoryPublisher(Space<std::tuple<double, double, double>>* spc, const std::string& name = SHM_NAME) : SpaceObserver<std::tuple<double, double, double>>(spc), name_(name), region_(nullptr), frame_(0), truncated_(false)
+	{
+		spdlog::get("console")->info("Starting shared memory publisher...");
+		shm_unlink(name_.c_str());
+		int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (fd < 0)
+			throw std::runtime_error("Cannot create shared memory " + name_ + ": " + std::strerror(errno) + ".");
+		if (ftruncate(fd, sizeof(ShmRegion)) < 0)
+		{
+			close(fd);
+			shm_unlink(name_.c_str());
+			throw std::runtime_error("Cannot size shared memory " + name_ + ": " + std::strerror(errno) + ".");
+		}
+		void* address = mmap(nullptr, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (address == MAP_FAILED)
+		{
+			shm_unlink(name_.c_str());
+			throw std::runtime_error("Cannot map shared memory " + name_ + ": " + std::strerror(errno) + ".");
+		}
+		region_ = static_cast<ShmRegion*>(address);
+		region_->header.version = SHM_VERSION;
+		region_->header.slots = SHM_SLOTS;
+		region_->header.capacity = SHM_CAPACITY;
+		region_->header.magic.store(SHM_MAGIC, std::memory_order_release);
+		spdlog::get("console")->info("Shared memory publisher started successfully on {}!", name_);
+	}
+
+	~SharedMemoryPublisher()
+	{
+		spdlog::get("console")->info("Stopping shared memory publisher...");
+		region_->header.closed.store(1, std::memory_order_release);
+		region_->header.futex.fetch_add(1, std::memory_order_release);
+		shmFutex(&region_->header.futex, FUTEX_WAKE, INT_MAX);
+		munmap(region_, sizeof(ShmRegion));
+		shm_unlink(name_.c_str());
+		spdlog::get("console")->info("Shared memory publisher stopped successfully!");
+	}
+
+	void fire(const ElementEvent& event, int id)
+	{
+		auto it = index_.find(id);
+		switch (event.get_state()) {
+			case ADD:
+			case UPDATE:
+			if (it == index_.end())
+			{
+				it = index_.emplace(id, elements_.size()).first;
+				elements_.push_back(ShmElement());
+				elements_.back().id = id;
+				elements_.back().event = -1;
+			}
+			if (elements_[it->second].event != ADD)
+				elements_[it->second].event = event.get_state();
+			break;
+			case REMOVE:
+			if (it != index_.end())
+			{
+				std::size_t slot = it->second;
+				index_.erase(it);
+				if (slot != elements_.size() - 1)
+				{
+					elements_[slot] = elements_.back();
+					index_[elements_[slot].id] = slot;
+				}
+				elements_.pop_back();
+			}
+			break;
+		}
+	}
+
+	// Every frame replaces the oldest slot of the ring with the full element state, then wakes the readers
+	// waiting for it, without a syscall when none is.
+	void commit()
+	{
+		TRACE_SCOPE("SharedMemoryPublisher::commit");
+		for (auto& element : elements_)
+			if (element.event >= 0)
+			{
+				std::tuple<double, double, double> position = spc_->getElement(element.id);
+				element.x = std::get<0>(position);
+				element.y = std::get<1>(position);
+				element.angle = std::get<2>(position);
+			}
+		std::size_t count = elements_.size();
+		if (count > SHM_CAPACITY)
+		{
+			if (!truncated_)
+				spdlog::get("console")->warn("Shared memory holds {} of {} elements.", SHM_CAPACITY, count);
+			count = SHM_CAPACITY;
+		}
+		truncated_ = (elements_.size() > SHM_CAPACITY);
+		ShmSlot& slot = region_->slots[++frame_ % SHM_SLOTS];
+		uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+		slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.count = count;
+		slot.frame = frame_;
+		slot.timestamp = shmNow();
+		std::memcpy(slot.elements, elements_.data(), count * sizeof(ShmElement));
+		slot.sequence.store(sequence + 2, std::memory_order_release);
+		region_->header.frame.store(frame_, std::memory_order_release);
+		region_->header.futex.fetch_add(1, std::memory_order_seq_cst);
+		if (region_->header.waiters.load(std::memory_order_seq_cst) != 0)
+			shmFutex(&region_->header.futex, FUTEX_WAKE, INT_MAX);
+		for (auto& element : elements_)
+			element.event = -1;
+	}
+};
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef SHAREDMEMORY_HPP
+#define SHAREDMEMORY_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define SHM_NAME "/sprits" // Default shared-memory object, mapped from /dev/shm.
+#define SHM_MAGIC 0x53505254 // "SPRT"
+#define SHM_VERSION 2
+#define SHM_SLOTS 8 // Frames kept in the ring, readers of the newest frame never race the writer.
+#define SHM_CAPACITY 1024 // Elements per frame, any further element is dropped.
+
+// Layout of the ring shared by the SharedMemoryPublisher and its readers.
+// Each slot holds the whole element state of one frame and is guarded by a
+// seqlock: the writer makes its sequence odd while filling it, and readers
+// retry until they copy a slot whose sequence was even and unchanged.
+namespace SPRITS
+{
+	struct ShmElement
+	{
+		int32_t id;
+		int32_t event; // ADD or UPDATE when the element changed in this frame, -1 otherwise.
+		double x, y, angle;
+	};
+
+	struct ShmSlot
+	{
+		std::atomic<uint32_t> sequence;
+		uint32_t count;
+		uint64_t frame;
+		uint64_t timestamp; // CLOCK_MONOTONIC nanoseconds of the commit.
+		ShmElement elements[SHM_CAPACITY];
+	};
+
+	struct ShmHeader
+	{
+		std::atomic<uint32_t> magic; // Written last, once the rest of the header is valid.
+		uint32_t version, slots, capacity;
+		std::atomic<uint32_t> closed; // Set when the publisher goes away, readers should reopen.
+		std::atomic<uint32_t> futex; // Bumped on every frame, readers wait on it.
+		std::atomic<uint32_t> waiters; // Readers in wait(), the publisher only wakes the futex when there are some.
+		std::atomic<uint64_t> frame; // Newest complete frame, 0 before the first one.
+	};
+
+	struct ShmRegion
+	{
+		ShmHeader header;
+		ShmSlot slots[SHM_SLOTS];
+	};
+
+	static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2, "Shared-memory ring needs lock-free atomics.");
+
+	inline long shmFutex(const std::atomic<uint32_t>* word, int op, uint32_t value, const struct timespec* timeout = nullptr)
+	{
+		return syscall(SYS_futex, reinterpret_cast<const uint32_t*>(word), op, value, timeout, nullptr, 0);
+	}
+
+	inline uint64_t shmNow()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+	}
+
+	// Maps the ring of a running publisher, writable only so wait() can count
+	// itself in the header, hence readers run as the publisher's user. Reading
+	// never takes a lock nor enters the kernel, only wait() sleeps on the futex.
+	class ShmReader
+	{
+	private:
+		ShmRegion* region_;
+		uint64_t last_;
+	public:
+		ShmReader(const std::string& name = SHM_NAME) : region_(nullptr), last_(0)
+		{
+			int fd = shm_open(name.c_str(), O_RDWR, 0);
+			if (fd < 0)
+				throw std::runtime_error("Cannot open shared memory " + name + ": " + std::strerror(errno) + ".");
+			void* address = mmap(nullptr, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			close(fd);
+			if (address == MAP_FAILED)
+				throw std::runtime_error("Cannot map shared memory " + name + ": " + std::strerror(errno) + ".");
+			region_ = static_cast<ShmRegion*>(address);
+			if ((region_->header.magic.load(std::memory_order_acquire) != SHM_MAGIC) || (region_->header.version != SHM_VERSION) || (region_->header.slots != SHM_SLOTS) || (region_->header.capacity != SHM_CAPACITY))
+			{
+				munmap(region_, sizeof(ShmRegion));
+				throw std::runtime_error("Incompatible shared memory " + name + ".");
+			}
+		}
+
+		~ShmReader()
+		{
+			munmap(region_, sizeof(ShmRegion));
+		}
+
+		ShmReader(const ShmReader&) = delete;
+		ShmReader& operator=(const ShmReader&) = delete;
+
+		bool closed() const
+		{
+			return region_->header.closed.load(std::memory_order_acquire) != 0;
+		}
+
+		uint64_t frame() const
+		{
+			return region_->header.frame.load(std::memory_order_acquire);
+		}
+
+		// Copies the newest frame into elements, returning its number, or 0 if
+		// nothing new was committed since the previous read.
+		uint64_t read(std::vector<ShmElement>& elements, uint64_t* timestamp = nullptr)
+		{
+			for (;;)
+			{
+				uint64_t frame = this->frame();
+				if ((frame == 0) || (frame == last_))
+					return 0;
+				const ShmSlot& slot = region_->slots[frame % SHM_SLOTS];
+				uint32_t before = slot.sequence.load(std::memory_order_acquire);
+				if (before & 1)
+					continue;
+				uint32_t count = slot.count;
+				if (count > SHM_CAPACITY)
+					continue;
+				uint64_t slotFrame = slot.frame, slotTime = slot.timestamp;
+				elements.resize(count);
+				std::memcpy(elements.data(), slot.elements, count * sizeof(ShmElement));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if ((slot.sequence.load(std::memory_order_relaxed) != before) || (slotFrame != frame))
+					continue;
+				if (timestamp)
+					*timestamp = slotTime;
+				return last_ = frame;
+			}
+		}
+
+		// Sleeps until a frame newer than the last one read is committed, at
+		// most timeout milliseconds (negative waits forever). Returns false on timeout.
+		bool wait(int timeout = -1)
+		{
+			ShmHeader& header = region_->header;
+			uint64_t deadline = (timeout < 0) ? 0 : shmNow() + uint64_t(timeout) * 1000000ull;
+			for (;;)
+			{
+				uint32_t word = header.futex.load(std::memory_order_acquire);
+				if ((frame() != last_) || closed())
+					return true;
+				struct timespec ts, *remaining = nullptr;
+				if (timeout >= 0)
+				{
+					uint64_t now = shmNow();
+					if (now >= deadline)
+						return false;
+					ts.tv_sec = (deadline - now) / 1000000000ull;
+					ts.tv_nsec = (deadline - now) % 1000000000ull;
+					remaining = &ts;
+				}
+				// Counting before checking the word again pairs with the publisher bumping it before reading
+				// waiters: either it sees this reader, or this reader sees the new frame and does not sleep.
+				header.waiters.fetch_add(1, std::memory_order_seq_cst);
+				if (header.futex.load(std::memory_order_seq_cst) == word)
+					shmFutex(&header.futex, FUTEX_WAIT, word, remaining);
+				header.waiters.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+	};
+}
+
+#endif
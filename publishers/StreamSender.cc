@@ -0,0 +1,424 @@
+#ifndef STREAMSENDER_CC
+#define STREAMSENDER_CC
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <TUIO/OscSender.h>
+#include <websocketpp/base64/base64.hpp>
+#include <websocketpp/sha1/sha1.hpp>
+#include <spdlog/spdlog.h>
+
+#define STREAM_MAX_SIZE 65535 // Largest OSC packet, so WebSocket frames always fit a 16-bit length.
+#define STREAM_MAX_PACKETS 256 // Packets a TUIO stream client may have queued before it is disconnected.
+#define STREAM_MAX_HANDSHAKE 8192 // Bytes of WebSocket handshake accepted before giving up on a client.
+#define STREAM_IOV 64 // Queued packets handed to a single sendmsg call.
+#define STREAM_CONNECT_TIMEOUT 2000 // Milliseconds a connection attempt to a TUIO client may block.
+#define STREAM_RETRY_MIN 500 // Milliseconds before redialing a TUIO client that dropped, doubled after each failure...
+#define STREAM_RETRY_MAX 30000 // ...up to this.
+
+// Sends OSC over TCP (length prefixed) or WebSocket (binary frames) to any number of clients from a
+// single epoll thread. Each packet is copied once and shared by all client queues; sockets are
+// non-blocking, so a stuck client only fills its own queue until it is disconnected. A sender
+// that connects to its client redials it with exponential backoff whenever the connection drops.
+class StreamSender : public TUIO::OscSender
+{
+public:
+	enum Framing { TCP, WEBSOCKET };
+private:
+	struct Packet
+	{
+		char header[10];
+		std::size_t size;
+		std::shared_ptr<const std::string> payload;
+	};
+
+	struct Client
+	{
+		bool open, writing;
+		std::string handshake, inbound;
+		std::deque<Packet> queue;
+		std::size_t offset;
+		uint64_t skip;
+		Client(bool open) : open(open), writing(false), offset(0), skip(0) { }
+	};
+
+	Framing framing_;
+	std::string host_;
+	int port_, listener_, epoll_, wakeup_;
+	std::map<int, Client> clients_;
+	std::mutex mutex_;
+	std::thread thread_;
+
+	static void nonblocking(int fd)
+	{
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	}
+
+	static int dial(const std::string& host, int port)
+	{
+		struct addrinfo hints, *addresses;
+		std::memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+			return -1;
+		struct timeval timeout = { STREAM_CONNECT_TIMEOUT / 1000, (STREAM_CONNECT_TIMEOUT % 1000) * 1000 };
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if ((fd >= 0) && ((setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) < 0) || (connect(fd, addresses->ai_addr, addresses->ai_addrlen) < 0)))
+		{
+			close(fd);
+			fd = -1;
+		}
+		freeaddrinfo(addresses);
+		if (fd >= 0)
+			nonblocking(fd);
+		return fd;
+	}
+
+	void watch(int fd, uint32_t events, int op = EPOLL_CTL_MOD)
+	{
+		struct epoll_event event;
+		std::memset(&event, 0, sizeof(event));
+		event.events = events;
+		event.data.fd = fd;
+		epoll_ctl(epoll_, op, fd, &event);
+	}
+
+	void start()
+	{
+		epoll_ = epoll_create1(EPOLL_CLOEXEC);
+		wakeup_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if ((epoll_ < 0) || (wakeup_ < 0))
+			throw std::runtime_error("Could not create TUIO stream event loop.");
+		watch(wakeup_, EPOLLIN, EPOLL_CTL_ADD);
+		if (listener_ >= 0)
+			watch(listener_, EPOLLIN, EPOLL_CTL_ADD);
+		for (const auto& it : clients_)
+			watch(it.first, EPOLLIN, EPOLL_CTL_ADD);
+		thread_ = std::thread(&StreamSender::run, this);
+	}
+
+	void drop(int fd, const char* reason)
+	{
+		spdlog::get("console")->info("TUIO {} client disconnected: {}", (framing_ == TCP) ? "TCP" : "WebSocket", reason);
+		epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, NULL);
+		close(fd);
+		clients_.erase(fd);
+	}
+
+	void push(int fd, Client& client, const char* header, std::size_t size, const std::shared_ptr<const std::string>& payload)
+	{
+		if (client.queue.size() >= STREAM_MAX_PACKETS)
+			return drop(fd, "outbound queue overflow");
+		Packet packet;
+		std::memcpy(packet.header, header, size);
+		packet.size = size;
+		packet.payload = payload;
+		client.queue.push_back(packet);
+		if (client.queue.size() == 1)
+			flush(fd, client);
+	}
+
+	// Writes as much of the queue as the socket takes, and waits for EPOLLOUT while anything is left.
+	void flush(int fd, Client& client)
+	{
+		while (!client.queue.empty())
+		{
+			struct iovec iov[2 * STREAM_IOV];
+			std::size_t count = 0, skip = client.offset;
+			for (auto it = client.queue.begin(); (it != client.queue.end()) && (count < 2 * STREAM_IOV); ++it)
+			{
+				std::size_t header = std::min(skip, it->size);
+				if (header < it->size)
+					iov[count++] = { const_cast<char*>(it->header) + header, it->size - header };
+				std::size_t body = skip - header;
+				if (body < it->payload->size())
+					iov[count++] = { const_cast<char*>(it->payload->data()) + body, it->payload->size() - body };
+				skip = 0;
+			}
+			struct msghdr msg;
+			std::memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iov;
+			msg.msg_iovlen = count;
+			ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (sent < 0)
+			{
+				if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+					return drop(fd, std::strerror(errno));
+				break;
+			}
+			std::size_t left = client.offset + sent;
+			while (!client.queue.empty() && (left >= client.queue.front().size + client.queue.front().payload->size()))
+			{
+				left -= client.queue.front().size + client.queue.front().payload->size();
+				client.queue.pop_front();
+			}
+			client.offset = left;
+		}
+		if (client.writing != !client.queue.empty())
+		{
+			client.writing = !client.queue.empty();
+			watch(fd, client.writing ? (EPOLLIN | EPOLLOUT) : EPOLLIN);
+		}
+	}
+
+	void handshake(int fd, Client& client)
+	{
+		std::size_t end = client.handshake.find("\r\n\r\n");
+		if (end == std::string::npos)
+		{
+			if (client.handshake.size() > STREAM_MAX_HANDSHAKE)
+				drop(fd, "handshake too long");
+			return;
+		}
+		std::string request = client.handshake.substr(0, end + 2);
+		std::transform(request.begin(), request.end(), request.begin(), ::tolower);
+		std::size_t key = request.find("\r\nsec-websocket-key:");
+		if (key == std::string::npos)
+			return drop(fd, "not a WebSocket handshake");
+		key += 20;
+		std::size_t eol = client.handshake.find("\r\n", key);
+		std::string accept = client.handshake.substr(key, eol - key);
+		accept.erase(0, accept.find_first_not_of(" \t"));
+		accept.erase(accept.find_last_not_of(" \t") + 1);
+		accept += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+		unsigned char digest[20];
+		websocketpp::sha1::calc(accept.data(), accept.size(), digest);
+		client.inbound = client.handshake.substr(end + 4);
+		client.handshake.clear();
+		client.open = true;
+		push(fd, client, "", 0, std::make_shared<const std::string>("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " + websocketpp::base64_encode(digest, sizeof(digest)) + "\r\n\r\n"));
+	}
+
+	// Client frames are only checked for close: payloads are skipped by length and an opcode is only
+	// read from a complete header, wherever recv happened to split the stream.
+	void parse(int fd, Client& client)
+	{
+		std::size_t used = 0;
+		while (used < client.inbound.size())
+		{
+			std::size_t available = client.inbound.size() - used;
+			if (client.skip > 0)
+			{
+				std::size_t skipped = static_cast<std::size_t>(std::min<uint64_t>(client.skip, available));
+				used += skipped;
+				client.skip -= skipped;
+				continue;
+			}
+			const unsigned char* frame = reinterpret_cast<const unsigned char*>(client.inbound.data()) + used;
+			if (available < 2)
+				break;
+			std::size_t length = frame[1] & 0x7f, extended = (length == 126) ? 2 : (length == 127) ? 8 : 0, header = 2 + extended + ((frame[1] & 0x80) ? 4 : 0);
+			if (available < header)
+				break;
+			if ((frame[0] & 0x0f) == 0x08)
+				return drop(fd, "close frame received");
+			client.skip = (extended > 0) ? 0 : length;
+			for (std::size_t i = 0; i < extended; ++i)
+				client.skip = (client.skip << 8) | frame[2 + i];
+			used += header;
+		}
+		client.inbound.erase(0, used);
+	}
+
+	void receive(int fd, Client& client)
+	{
+		char buffer[1024];
+		for (;;)
+		{
+			ssize_t count = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+			if (count == 0)
+				return drop(fd, "connection closed");
+			if (count < 0)
+			{
+				if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+					drop(fd, std::strerror(errno));
+				return;
+			}
+			if (!client.open)
+			{
+				client.handshake.append(buffer, count);
+				handshake(fd, client);
+			} else if (framing_ == WEBSOCKET)
+				client.inbound.append(buffer, count);
+			else
+				continue;
+			if ((clients_.count(fd) > 0) && (framing_ == WEBSOCKET) && client.open)
+				parse(fd, client);
+			if (clients_.count(fd) == 0)
+				return;
+		}
+	}
+
+	void run()
+	{
+		struct epoll_event events[64];
+		int retry = STREAM_RETRY_MIN;
+		for (;;)
+		{
+			int count = epoll_wait(epoll_, events, 64, host_.empty() ? -1 : retry);
+			if ((count < 0) && (errno != EINTR))
+				return;
+			if ((count == 0) && !host_.empty())
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					if (!clients_.empty())
+						continue;
+				}
+				int fd = dial(host_, port_);
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (fd < 0)
+				{
+					retry = std::min(2 * retry, STREAM_RETRY_MAX);
+					spdlog::get("console")->warn("Could not reconnect to TUIO client {}:{}, retrying in {} ms.", host_, port_, retry);
+					continue;
+				}
+				retry = STREAM_RETRY_MIN;
+				clients_.emplace(fd, Client(true));
+				watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+				spdlog::get("console")->info("TUIO TCP client {}:{} reconnected.", host_, port_);
+				continue;
+			}
+			std::lock_guard<std::mutex> lock(mutex_);
+			for (int i = 0; i < count; ++i)
+			{
+				int fd = events[i].data.fd;
+				if (fd == wakeup_)
+					return;
+				if (fd == listener_)
+				{
+					int client;
+					while ((client = accept4(listener_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+					{
+						clients_.emplace(client, Client(framing_ == TCP));
+						watch(client, EPOLLIN, EPOLL_CTL_ADD);
+						spdlog::get("console")->info("TUIO {} client connected.", (framing_ == TCP) ? "TCP" : "WebSocket");
+					}
+					continue;
+				}
+				auto it = clients_.find(fd);
+				if (it == clients_.end())
+					continue;
+				if (events[i].events & (EPOLLERR | EPOLLHUP))
+					drop(fd, "socket error");
+				else if (events[i].events & EPOLLIN)
+					receive(fd, it->second);
+				if ((events[i].events & EPOLLOUT) && (clients_.count(fd) > 0))
+					flush(fd, it->second);
+			}
+		}
+	}
+public:
+	StreamSender(int port, Framing framing) : framing_(framing), port_(port), listener_(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)), epoll_(-1), wakeup_(-1)
+	{
+		local = false;
+		buffer_size = STREAM_MAX_SIZE;
+		int reuse = 1;
+		struct sockaddr_in address;
+		std::memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+		if ((listener_ < 0) || (setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) || (bind(listener_, (struct sockaddr*)&address, sizeof(address)) < 0) || (listen(listener_, SOMAXCONN) < 0))
+		{
+			if (listener_ >= 0)
+				close(listener_);
+			throw std::runtime_error("Could not listen for TUIO clients on port " + std::to_string(port) + ".");
+		}
+		nonblocking(listener_);
+		start();
+	}
+
+	StreamSender(const char* host, int port) : framing_(TCP), host_(host), port_(port), listener_(-1), epoll_(-1), wakeup_(-1)
+	{
+		local = (host_ == "localhost") || (host_ == "127.0.0.1");
+		buffer_size = STREAM_MAX_SIZE;
+		int fd = dial(host_, port_);
+		if (fd < 0)
+			throw std::runtime_error("Could not connect to TUIO client " + host_ + ":" + std::to_string(port) + ".");
+		clients_.emplace(fd, Client(true));
+		start();
+	}
+
+	~StreamSender()
+	{
+		uint64_t one = 1;
+		if (write(wakeup_, &one, sizeof(one)) == sizeof(one))
+			thread_.join();
+		else
+			thread_.detach();
+		for (const auto& it : clients_)
+			close(it.first);
+		if (listener_ >= 0)
+			close(listener_);
+		close(epoll_);
+		close(wakeup_);
+	}
+
+	bool sendOscPacket(osc::OutboundPacketStream *bundle)
+	{
+		std::size_t size = bundle->Size();
+		if ((size == 0) || (size > buffer_size))
+			return false;
+		char header[10];
+		std::size_t length;
+		if (framing_ == TCP)
+		{
+			length = 4;
+			for (std::size_t i = 0; i < 4; ++i)
+				header[i] = static_cast<char>((size >> (8 * (3 - i))) & 0xff);
+		} else
+		{
+			header[0] = static_cast<char>(0x82);
+			if (size < 126)
+			{
+				length = 2;
+				header[1] = static_cast<char>(size);
+			} else
+			{
+				length = 4;
+				header[1] = 126;
+				header[2] = static_cast<char>((size >> 8) & 0xff);
+				header[3] = static_cast<char>(size & 0xff);
+			}
+		}
+		std::shared_ptr<const std::string> payload = std::make_shared<const std::string>(bundle->Data(), size);
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto it = clients_.begin(); it != clients_.end();)
+		{
+			auto client = it++;
+			if (client->second.open)
+				push(client->first, client->second, header, length, payload);
+		}
+		return true;
+	}
+
+	bool isConnected()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return std::any_of(clients_.begin(), clients_.end(), [](const std::pair<const int, Client>& client) { return client.second.open; });
+	}
+};
+
+#endif
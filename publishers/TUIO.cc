@@ -1,58 +1,134 @@
 #ifndef TUIO_CC
 #define TUIO_CC
 
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include <TUIO/TuioServer.h>
-#include <TUIO/WebSockSender.h>
+#include <TUIO/UdpSender.h>
+#include <boost/lexical_cast.hpp>
 #include <spdlog/spdlog.h>
 
 #include <Space.hpp>
+#include <publishers/StreamSender.cc>
 
 using namespace SPRITS;
 
+#define TUIO_SENDERS "udp:localhost:3333,ws:8080" // Default transports, see TUIOPublisher::sender.
+
+// Velocities and accelerations of set messages come from the motion history of the Space, rotations
+// in turns as TuioObject computes them. Positions may be extrapolated from that history to the time
+// they are sent, compensating the latency since the sensor captured them.
 class TUIOPublisher : public SpaceObserver<std::tuple<double, double, double>>
 {
 private:
 	TUIO::TuioServer *server;
-	TUIO::TuioObject *objects[1024];
-	TUIO::OscSender *ws_sender;
+	std::unordered_map<int, TUIO::TuioObject*> objects;
+	std::vector<TUIO::OscSender*> senders;
+	std::vector<std::pair<ElementEvent_type, int>> frame;
+	bool extrapolate;
+	
+	// Senders are given as udp:<host>:<port>, tcp:<port> (listening), tcp:<host>:<port> (connecting) or ws:<port>.
+	static TUIO::OscSender* sender(const std::string& spec)
+	{
+		std::size_t first = spec.find(':'), last = spec.rfind(':');
+		if (first == std::string::npos)
+			throw std::runtime_error("Invalid TUIO sender " + spec + ".");
+		std::string protocol = spec.substr(0, first), host = (first == last) ? "" : spec.substr(first + 1, last - first - 1);
+		int port = boost::lexical_cast<int>(spec.substr(last + 1));
+		if (protocol == "udp")
+			return new TUIO::UdpSender(host.empty() ? "localhost" : host.c_str(), port);
+		if (protocol == "tcp")
+			return host.empty() ? new StreamSender(port, StreamSender::TCP) : new StreamSender(host.c_str(), port);
+		if ((protocol == "ws") && host.empty())
+			return new StreamSender(port, StreamSender::WEBSOCKET);
+		throw std::runtime_error("Invalid TUIO sender " + spec + ".");
+	}
 public:
-	TUIOPublisher(Space<std::tuple<double, double, double>>* spc) : SpaceObserver<std::tuple<double, double, double>>(spc) {
+	TUIOPublisher(Space<std::tuple<double, double, double>>* spc, const std::string& specs = TUIO_SENDERS, bool extrapolate = false) : SpaceObserver<std::tuple<double, double, double>>(spc), extrapolate(extrapolate) {
 		spdlog::get("console")->info("Starting TUIO Server...");
-		server = new TUIO::TuioServer();
-		ws_sender = new TUIO::WebSockSender(8080);
-		server->addOscSender(ws_sender);
+		std::istringstream list(specs);
+		for (std::string spec; std::getline(list, spec, ',');)
+			senders.push_back(sender(spec));
+		if (senders.empty())
+			throw std::runtime_error("No TUIO sender given.");
+		server = new TUIO::TuioServer(senders.front());
+		for (std::size_t i = 1; i < senders.size(); ++i)
+			server->addOscSender(senders[i]);
 		server->setVerbose(false);
-		spdlog::get("console")->info("TUIO Server started successfully!");
+		spc->recordHistory();
+		spdlog::get("console")->info("TUIO Server started successfully on {}!", specs);
 	}
 	
 	~TUIOPublisher()
 	{
 		spdlog::get("console")->info("Stopping TUIO Server...");
 		delete server;
-		delete ws_sender;
+		for (auto sender : senders)
+			delete sender;
 		spdlog::get("console")->info("TUIO Server stopped successfully!");
 	}
 	
 	void fire(const ElementEvent& event, int id)
 	{
-		server->initFrame(TUIO::TuioTime::getSessionTime());
-		switch (event.get_state()) {
-			case ADD:
-			objects[id] = server->addTuioObject(id, std::get<0>(spc_->getElement(id)), std::get<1>(spc_->getElement(id)), std::get<2>(spc_->getElement(id)));
-			spdlog::get("console")->debug("[NEW TAG]: id {}", id);
-			break;
-			case UPDATE:
-			server->updateTuioObject(objects[id], std::get<0>(spc_->getElement(id)), std::get<1>(spc_->getElement(id)), std::get<2>(spc_->getElement(id)));
-			spdlog::get("console")->debug("[UPDATE TAG]: id {} {} {} {}", id, std::get<0>(spc_->getElement(id)), std::get<1>(spc_->getElement(id)), std::get<2>(spc_->getElement(id)));
-			break;
-			case REMOVE:
-			server->removeTuioObject(objects[id]);
-			objects[id] = NULL;
-			spdlog::get("console")->debug("[REMOVE TAG]: id {}", id);
-			break;
+		frame.push_back(std::make_pair(event.get_state(), id));
+	}
+	
+	// Every change of a Space frame goes out in a single bundle, encoded once for all senders.
+	void commit()
+	{
+		if (frame.empty())
+			return;
+		TRACE_SCOPE("TUIOPublisher::commit");
+		TUIO::TuioTime time = TUIO::TuioTime::getSessionTime();
+		MotionClock::time_point now = MotionClock::now();
+		server->initFrame(time);
+		for (auto const& change : frame)
+		{
+			int id = change.second;
+			auto object = objects.find(id);
+			switch (change.first) {
+				case ADD:
+				{
+					std::tuple<double, double, double> element = extrapolate ? spc_->getElementAt(id, now) : spc_->getElement(id);
+					objects[id] = server->addTuioObject(id, std::get<0>(element), std::get<1>(element), std::get<2>(element));
+					SPDLOG_DEBUG(spdlog::get("console"), "[NEW TAG]: id {}", id);
+				}
+				break;
+				case UPDATE:
+				if (object != objects.end())
+				{
+					std::tuple<double, double, double> element = extrapolate ? spc_->getElementAt(id, now) : spc_->getElement(id);
+					MotionSample<std::tuple<double, double, double>> motion;
+					if (spc_->getMotion(id, motion))
+					{
+						double vx = std::get<0>(motion.velocity), vy = std::get<1>(motion.velocity), speed = std::hypot(vx, vy);
+						double accel = (speed > 0) ? (vx * std::get<0>(motion.acceleration) + vy * std::get<1>(motion.acceleration)) / speed : 0;
+						object->second->update(time, std::get<0>(element), std::get<1>(element), std::get<2>(element), vx, vy, std::get<2>(motion.velocity) / (2 * M_PI), accel, std::get<2>(motion.acceleration) / (2 * M_PI));
+						server->updateExternalTuioObject(object->second);
+					} else
+						server->updateTuioObject(object->second, std::get<0>(element), std::get<1>(element), std::get<2>(element));
+					SPDLOG_DEBUG(spdlog::get("console"), "[UPDATE TAG]: id {} {} {} {}", id, std::get<0>(element), std::get<1>(element), std::get<2>(element));
+				}
+				break;
+				case REMOVE:
+				if (object != objects.end())
+				{
+					server->removeTuioObject(object->second);
+					objects.erase(object);
+					SPDLOG_DEBUG(spdlog::get("console"), "[REMOVE TAG]: id {}", id);
+				}
+				break;
+			}
 		}
 		server->commitFrame();
+		frame.clear();
 	}
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,7 +1,25 @@
 #ifndef WEBSOCKET_CC
 #define WEBSOCKET_CC
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
 #include <websocketpp/server.hpp>
 #include <spdlog/spdlog.h>
 
@@ -11,51 +29,876 @@
 
 using namespace SPRITS;
 
-class WebSocketPublisher : public SpaceObserver<std::tuple<double, double, double>>
+#define BINARY_PROTOCOL "sprits.binary.v2" // Sec-WebSocket-Protocol selecting the binary encoding, JSON is used otherwise.
+#define BINARY_MAGIC 0x54525053 // "SPRT" as a little-endian uint32.
+#define BINARY_VERSION 2
+#define BINARY_SNAPSHOT 0x01 // Header flag marking a frame that replaces the whole client state.
+#define BINARY_HEADER_SIZE 24
+#define BINARY_RECORD_SIZE 28
+#define BINARY_MAX_RECORDS 65535 // Records a binary message can count in its header, larger sets are split.
+#define HISTORY_SIZE 4096 // Recent deltas kept for clients resuming with ?since=<seq>.
+#define MAX_QUEUE 4096 // Distinct elements a client may have pending before it is disconnected.
+#define HIGH_WATERMARK (1 << 20) // Bytes buffered by websocketpp above which a client is considered behind.
+#define BEHIND_TIMEOUT 5000 // Milliseconds a client may stay behind before it is disconnected.
+#define RETRY_PERIOD 20 // Milliseconds between flush attempts while a client is behind.
+#define DEFLATE_THRESHOLD 1024 // Messages larger than this many bytes are compressed for clients that negotiated permessage-deflate.
+#define WHEEL_TICK 10 // Milliseconds per slot of the timer wheel pacing rate-limited clients.
+#define WHEEL_SLOTS 256
+#define MIN_RATE 0.1 // Lowest update rate in Hz a client may request, lower ones are raised to it.
+#define STATS_PERIOD 10000 // Milliseconds between client statistics reports.
+#define POOL_PROBES 8 // Pooled messages inspected for a free one before a new message is allocated.
+
+class JsonWriter
+{
+private:
+	std::string& out_;
+	bool first_;
+	
+	void separate()
+	{
+		if (!first_)
+			out_ += ',';
+		first_ = false;
+	}
+public:
+	JsonWriter(std::string& out) : out_(out), first_(true) { }
+	
+	JsonWriter& beginObject() { separate(); out_ += '{'; first_ = true; return *this; }
+	
+	JsonWriter& endObject() { out_ += '}'; first_ = false; return *this; }
+	
+	JsonWriter& beginArray() { separate(); out_ += '['; first_ = true; return *this; }
+	
+	JsonWriter& endArray() { out_ += ']'; first_ = false; return *this; }
+	
+	JsonWriter& key(const char* name)
+	{
+		value(name);
+		out_ += ':';
+		first_ = true;
+		return *this;
+	}
+	
+	JsonWriter& value(const char* str)
+	{
+		separate();
+		out_ += '"';
+		for (; *str; ++str)
+		{
+			if ((*str == '"') || (*str == '\\'))
+				out_ += '\\';
+			out_ += *str;
+		}
+		out_ += '"';
+		return *this;
+	}
+	
+	JsonWriter& value(int number)
+	{
+		char buffer[16];
+		separate();
+		out_.append(buffer, std::snprintf(buffer, sizeof(buffer), "%d", number));
+		return *this;
+	}
+	
+	JsonWriter& value(uint64_t number)
+	{
+		char buffer[24];
+		separate();
+		out_.append(buffer, std::snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(number)));
+		return *this;
+	}
+	
+	JsonWriter& value(double number)
+	{
+		char buffer[32];
+		separate();
+		if (std::isfinite(number))
+			out_.append(buffer, std::snprintf(buffer, sizeof(buffer), "%.17g", number));
+		else
+			out_ += "null";
+		return *this;
+	}
+};
+
+// Binary frames carry every change of one Space frame: a header (uint32 magic, uint8 version,
+// uint8 flags, uint16 record count, uint64 timestamp in microseconds, uint64 sequence of the newest
+// record) followed by one record per change (uint64 timestamp in microseconds, int32 id, uint8 op,
+// 3 padding bytes, float32 x, y, angle). Everything is little-endian.
+class BinaryWriter
+{
+private:
+	std::string& out_;
+	
+	template<typename U> BinaryWriter& put(U number)
+	{
+		for (std::size_t i = 0; i < sizeof(U); ++i)
+			out_ += static_cast<char>((number >> (8 * i)) & 0xff);
+		return *this;
+	}
+public:
+	BinaryWriter(std::string& out) : out_(out) { }
+	
+	BinaryWriter& value(uint8_t number) { return put(number); }
+	
+	BinaryWriter& value(uint16_t number) { return put(number); }
+	
+	BinaryWriter& value(uint32_t number) { return put(number); }
+	
+	BinaryWriter& value(uint64_t number) { return put(number); }
+	
+	BinaryWriter& value(int32_t number) { return put(static_cast<uint32_t>(number)); }
+	
+	BinaryWriter& value(float number)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &number, sizeof(bits));
+		return put(bits);
+	}
+	
+	BinaryWriter& pad(std::size_t count)
+	{
+		out_.append(count, '\0');
+		return *this;
+	}
+	
+	static uint64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+};
+
+// Hands out websocketpp messages and takes them back once the pool holds their last reference, that
+// is once every client has sent them and no update or batch refers to them any more. Messages are
+// mostly released in the order they were taken, so a round-robin probe finds a free one right away
+// and encoding reuses payload buffers instead of allocating a message per payload.
+template<typename Manager> class MessagePool
+{
+private:
+	typedef typename Manager::message_ptr message_ptr;
+	typename Manager::ptr manager_;
+	std::vector<message_ptr> messages_;
+	std::size_t cursor_;
+	std::mutex mutex_;
+public:
+	MessagePool() : manager_(std::make_shared<Manager>()), cursor_(0) { }
+	
+	message_ptr get(websocketpp::frame::opcode::value op, std::size_t size)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (std::size_t i = 0, n = std::min<std::size_t>(POOL_PROBES, messages_.size()); i < n; ++i)
+		{
+			message_ptr& msg = messages_[cursor_];
+			cursor_ = (cursor_ + 1) % messages_.size();
+			if (msg.use_count() == 1)
+			{
+				// Pairs with the release of the last other reference, whose thread may have read the payload.
+				std::atomic_thread_fence(std::memory_order_acquire);
+				msg->set_opcode(op);
+				msg->set_prepared(false);
+				msg->set_compressed(false);
+				msg->set_terminal(false);
+				msg->set_fin(true);
+				msg->get_raw_payload().clear();
+				msg->get_raw_payload().reserve(size);
+				return msg;
+			}
+		}
+		messages_.push_back(manager_->get_message(op, size));
+		return messages_.back();
+	}
+};
+
+// Filter installed by a client with {"filter": {"ids": [3, [10, 20]], "regions": [[x0, y0, x1, y1], [[x, y], ...]], "types": ["tag", "finger"]}}.
+// Ids are single values or inclusive ranges, regions are rectangles or polygons in plane coordinates.
+// An element matches when it passes every criterion present, {"filter": null} removes the filter.
+class SubscriptionFilter
 {
 private:
-	std::thread thread_;
-	websocketpp::server<websocketpp::config::asio> server_;
-    std::set<websocketpp::connection_hdl,std::owner_less<websocketpp::connection_hdl>> connections_;
-    std::mutex mutex_;
+	typedef std::vector<std::pair<double, double>> Polygon;
+	std::vector<std::pair<int, int>> ids_;
+	std::vector<Polygon> regions_;
+	bool tags_, fingers_;
+	
+	static double number(const Json::Value& value)
+	{
+		if (!value.isNumeric())
+			throw std::runtime_error("Filter coordinates must be numbers.");
+		return value.asDouble();
+	}
+	
+	static bool inside(const Polygon& polygon, double x, double y)
+	{
+		bool in = false;
+		for (std::size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+			if (((polygon[i].second > y) != (polygon[j].second > y)) && (x < polygon[j].first + (polygon[i].first - polygon[j].first) * (y - polygon[j].second) / (polygon[i].second - polygon[j].second)))
+				in = !in;
+		return in;
+	}
 public:
-	WebSocketPublisher(Space<std::tuple<double, double, double>>* spc, int port = 9002) : SpaceObserver<std::tuple<double, double, double>>(spc) {
+	SubscriptionFilter(const Json::Value& filter) : tags_(true), fingers_(true)
+	{
+		if (!filter.isObject())
+			throw std::runtime_error("Filter must be an object.");
+		if (filter.isMember("ids"))
+		{
+			if (!filter["ids"].isArray())
+				throw std::runtime_error("Filter ids must be an array.");
+			for (const auto& id : filter["ids"])
+				if (id.isIntegral())
+					ids_.push_back(std::make_pair(id.asInt(), id.asInt()));
+				else if (id.isArray() && (id.size() == 2) && id[0].isIntegral() && id[1].isIntegral())
+					ids_.push_back(std::make_pair(id[0].asInt(), id[1].asInt()));
+				else
+					throw std::runtime_error("Filter ids must be integers or [first, last] ranges.");
+		}
+		if (filter.isMember("regions"))
+		{
+			if (!filter["regions"].isArray())
+				throw std::runtime_error("Filter regions must be an array.");
+			for (const auto& region : filter["regions"])
+			{
+				if (!region.isArray())
+					throw std::runtime_error("Filter regions must be rectangles or polygons.");
+				Polygon polygon;
+				if ((region.size() == 4) && region[0].isNumeric())
+				{
+					double x0 = number(region[0]), y0 = number(region[1]), x1 = number(region[2]), y1 = number(region[3]);
+					polygon = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+				} else
+					for (const auto& point : region)
+					{
+						if (!point.isArray() || (point.size() != 2))
+							throw std::runtime_error("Filter polygon points must be [x, y] pairs.");
+						polygon.push_back(std::make_pair(number(point[0]), number(point[1])));
+					}
+				if (polygon.size() < 3)
+					throw std::runtime_error("Filter polygons need at least three points.");
+				regions_.push_back(polygon);
+			}
+		}
+		if (filter.isMember("types"))
+		{
+			if (!filter["types"].isArray())
+				throw std::runtime_error("Filter types must be an array.");
+			tags_ = fingers_ = false;
+			for (const auto& type : filter["types"])
+				if (type == "tag")
+					tags_ = true;
+				else if (type == "finger")
+					fingers_ = true;
+				else
+					throw std::runtime_error("Filter types must be \"tag\" or \"finger\".");
+		}
+	}
+	
+	bool match(int id, const std::tuple<double, double, double>& element) const
+	{
+		if (!(((id >= FINGER_ID_OFFSET) && (id < REMOTE_ID_OFFSET)) ? fingers_ : tags_))
+			return false;
+		if (!ids_.empty() && std::none_of(ids_.begin(), ids_.end(), [id](const std::pair<int, int>& range) { return (id >= range.first) && (id <= range.second); }))
+			return false;
+		return regions_.empty() || std::any_of(regions_.begin(), regions_.end(), [&element](const Polygon& polygon) { return inside(polygon, std::get<0>(element), std::get<1>(element)); });
+	}
+};
+
+struct DeflateConfig : public websocketpp::config::asio
+{
+	typedef DeflateConfig type;
+	struct permessage_deflate_config { };
+	typedef websocketpp::extensions::permessage_deflate::enabled<permessage_deflate_config> permessage_deflate_type;
+};
+
+template<typename Config> class BasicWebSocketPublisher : public SpaceObserver<std::tuple<double, double, double>>
+{
+private:
+	typedef websocketpp::server<Config> server_type;
+	typedef typename Config::message_type::ptr message_ptr;
+	typedef typename Config::con_msg_manager_type con_msg_manager_type;
+	
+	struct Update
+	{
+		ElementEvent_type op;
+		int id;
+		std::tuple<double, double, double> element;
+		uint64_t time, seq;
+		message_ptr json;
+		MotionClock::time_point sensor;
+	};
+	
+	struct Client
+	{
+		websocketpp::connection_hdl hdl;
+		bool binary, deflate, scheduled, wheeled;
+		std::mutex mutex;
+		std::unordered_map<int, Update> pending, sending;
+		std::shared_ptr<const SubscriptionFilter> filter;
+		std::unordered_set<int> visible;
+		message_ptr batch;
+		std::size_t period, dropped, sent;
+		std::atomic<uint64_t> bytes;
+		MotionClock::time_point behind;
+		Client(websocketpp::connection_hdl hdl, bool binary, bool deflate) : hdl(hdl), binary(binary), deflate(deflate), scheduled(false), wheeled(false), period(0), dropped(0), sent(0), bytes(0), behind() { }
+	};
+	
+	struct WheelEntry
+	{
+		std::weak_ptr<Client> client;
+		std::size_t rounds;
+	};
+	
+	std::vector<std::thread> threads_;
+	server_type server_;
+	std::map<websocketpp::connection_hdl, std::shared_ptr<Client>, std::owner_less<websocketpp::connection_hdl>> clients_;
+	std::mutex mutex_;
+	MessagePool<con_msg_manager_type> pool_;
+	std::size_t threshold_;
+	std::vector<Update> frame_, history_;
+	std::unordered_map<int, Update> state_;
+	std::vector<std::vector<WheelEntry>> wheel_;
+	std::size_t historyHead_, cursor_, wheeled_;
+	bool ticking_;
+	uint64_t sequence_, committed_;
+	std::atomic<uint64_t> bytes_;
+	
+	static void prepare(message_ptr msg)
+	{
+		websocketpp::frame::basic_header header(msg->get_opcode(), msg->get_payload().size(), true, false);
+		msg->set_header(websocketpp::frame::prepare_header(header, websocketpp::frame::extended_header(msg->get_payload().size())));
+		msg->set_prepared(true);
+	}
+	
+	message_ptr encodeJson(const Update& update)
+	{
+		TRACE_SCOPE("WebSocketPublisher::encodeJson");
+		message_ptr msg = pool_.get(websocketpp::frame::opcode::text, 128);
+		JsonWriter(msg->get_raw_payload()).beginObject()
+			.key("angle").value(std::get<2>(update.element))
+			.key("id").value(update.id)
+			.key("op").value(ElementEvent(update.op).get_state_as_string())
+			.key("pos").beginArray().value(std::get<0>(update.element)).value(std::get<1>(update.element)).endArray()
+			.key("seq").value(update.seq)
+			.endObject();
+		msg->get_raw_payload() += '\n';
+		prepare(msg);
+		return msg;
+	}
+	
+	message_ptr encodeSnapshot()
+	{
+		message_ptr msg = pool_.get(websocketpp::frame::opcode::text, 64 + 96 * state_.size());
+		JsonWriter writer(msg->get_raw_payload());
+		writer.beginObject().key("elements").beginArray();
+		for (const auto& it : state_)
+			writer.beginObject()
+				.key("angle").value(std::get<2>(it.second.element))
+				.key("id").value(it.second.id)
+				.key("pos").beginArray().value(std::get<0>(it.second.element)).value(std::get<1>(it.second.element)).endArray()
+				.endObject();
+		writer.endArray().key("op").value("SNAPSHOT").key("seq").value(committed_).endObject();
+		msg->get_raw_payload() += '\n';
+		prepare(msg);
+		return msg;
+	}
+	
+	// Encodes count updates from it, at most BINARY_MAX_RECORDS, and leaves it past them.
+	template<typename Iterator> message_ptr encodeBinary(Iterator& it, std::size_t count, uint64_t seq, uint8_t flags = 0)
+	{
+		TRACE_SCOPE("WebSocketPublisher::encodeBinary");
+		message_ptr msg = pool_.get(websocketpp::frame::opcode::binary, BINARY_HEADER_SIZE + BINARY_RECORD_SIZE * count);
+		BinaryWriter writer(msg->get_raw_payload());
+		writer.value(static_cast<uint32_t>(BINARY_MAGIC)).value(static_cast<uint8_t>(BINARY_VERSION)).value(flags).value(static_cast<uint16_t>(count)).value(BinaryWriter::now()).value(seq);
+		for (std::size_t i = 0; i < count; ++i, ++it)
+		{
+			const Update& update = record(*it);
+			writer.value(update.time).value(static_cast<int32_t>(update.id)).value(static_cast<uint8_t>(update.op)).pad(3)
+				.value(static_cast<float>(std::get<0>(update.element))).value(static_cast<float>(std::get<1>(update.element))).value(static_cast<float>(std::get<2>(update.element)));
+		}
+		prepare(msg);
+		return msg;
+	}
+	
+	// Splits updates in as many messages as the record count requires, only the first one replaces the state.
+	template<typename Updates> void deliverBinary(typename server_type::connection_ptr con, Client& client, const Updates& updates, uint64_t seq, uint8_t flags = 0)
+	{
+		auto it = updates.begin();
+		std::size_t left = updates.size();
+		do
+		{
+			std::size_t count = std::min<std::size_t>(left, BINARY_MAX_RECORDS);
+			deliver(con, client, encodeBinary(it, count, seq, flags));
+			left -= count;
+			flags &= ~BINARY_SNAPSHOT;
+		} while (left > 0);
+	}
+	
+	static const Update& record(const Update& update) { return update; }
+	
+	static const Update& record(const Update* update) { return *update; }
+	
+	static const Update& record(const std::pair<const int, Update>& update) { return update.second; }
+	
+	static void coalesce(Client& client, const Update& update)
+	{
+		auto it = client.pending.find(update.id);
+		if (it == client.pending.end())
+		{
+			client.pending.emplace(update.id, update);
+			return;
+		}
+		++client.dropped;
+		Update& queued = it->second;
+		if ((queued.op == ADD) && (update.op == REMOVE))
+			client.pending.erase(it);
+		else if ((queued.op == ADD) || ((queued.op == REMOVE) && (update.op == ADD)))
+		{
+			ElementEvent_type op = (queued.op == ADD) ? ADD : UPDATE;
+			queued = update;
+			queued.op = op;
+			queued.json.reset();
+		} else
+			queued = update;
+	}
+	
+	// Turns an update into what a filtered client sees: elements entering its filter are added, leaving ones removed.
+	static void route(Client& client, const Update& update, bool match)
+	{
+		bool visible = client.visible.count(update.id) > 0;
+		if (!match && !visible)
+			return;
+		Update routed = update;
+		routed.op = !match ? REMOVE : (visible ? update.op : ADD);
+		if (routed.op != update.op)
+			routed.json.reset();
+		if (match)
+			client.visible.insert(update.id);
+		else
+			client.visible.erase(update.id);
+		coalesce(client, routed);
+	}
+	
+	void enqueue(const std::shared_ptr<Client>& client, message_ptr batch)
+	{
+		std::lock_guard<std::mutex> lock(client->mutex);
+		bool fresh = client->pending.empty();
+		for (const auto& update : frame_)
+			if (client->filter)
+				route(*client, update, (update.op != REMOVE) && client->filter->match(update.id, update.element));
+			else
+				coalesce(*client, update);
+		client->batch = (!client->filter && fresh && (client->pending.size() == frame_.size())) ? batch : message_ptr();
+		if (client->pending.size() > MAX_QUEUE)
+		{
+			client->pending.clear();
+			server_.get_io_service().post(std::bind(&BasicWebSocketPublisher::drop, this, client, "Outbound queue overflow."));
+		} else if (!client->scheduled && !client->pending.empty() && (client->period == 0))
+		{
+			client->scheduled = true;
+			schedule(client);
+		}
+	}
+	
+	void schedule(std::shared_ptr<Client> client)
+	{
+		websocketpp::lib::error_code ec;
+		typename server_type::connection_ptr con = server_.get_con_from_hdl(client->hdl, ec);
+		if (!ec)
+			con->get_strand()->post(std::bind(&BasicWebSocketPublisher::flush, this, client));
+	}
+	
+	void drop(std::shared_ptr<Client> client, const char* reason)
+	{
+		websocketpp::lib::error_code ec;
+		spdlog::get("console")->warn("Disconnecting WebSocket client: {}", reason);
+		server_.close(client->hdl, websocketpp::close::status::try_again_later, reason, ec);
+	}
+	
+	void flush(std::shared_ptr<Client> client)
+	{
+		TRACE_SCOPE("WebSocketPublisher::flush");
+		websocketpp::lib::error_code ec;
+		typename server_type::connection_ptr con = server_.get_con_from_hdl(client->hdl, ec);
+		if (ec)
+			return;
+		message_ptr batch;
+		{
+			std::lock_guard<std::mutex> lock(client->mutex);
+			if (con->get_buffered_amount() > HIGH_WATERMARK)
+			{
+				MotionClock::time_point now = MotionClock::now();
+				if (client->behind == MotionClock::time_point())
+					client->behind = now;
+				if (now - client->behind > std::chrono::milliseconds(BEHIND_TIMEOUT))
+				{
+					client->pending.clear();
+					server_.get_io_service().post(std::bind(&BasicWebSocketPublisher::drop, this, client, "Client too slow."));
+				} else
+					server_.set_timer(RETRY_PERIOD, std::bind(&BasicWebSocketPublisher::schedule, this, client));
+				return;
+			}
+			client->behind = MotionClock::time_point();
+			client->sending.swap(client->pending);
+			batch.swap(client->batch);
+		}
+		
+		// Deltas go out in sequence order, so whatever prefix reaches a client it can resume from its last sequence.
+		std::vector<const Update*> ordered;
+		ordered.reserve(client->sending.size());
+		for (const auto& it : client->sending)
+			ordered.push_back(&it.second);
+		std::sort(ordered.begin(), ordered.end(), [](const Update* a, const Update* b) { return a->seq < b->seq; });
+		if (client->binary && !ordered.empty())
+		{
+			if (batch)
+				deliver(con, *client, batch);
+			else
+				deliverBinary(con, *client, ordered, ordered.back()->seq);
+		} else
+			for (auto update : ordered)
+				deliver(con, *client, update->json ? update->json : encodeJson(*update));
+		if (!ordered.empty() && (ordered.back()->sensor != MotionClock::time_point()))
+			Metrics::stage(SEND).record(MotionClock::now() - ordered.back()->sensor);
+		
+		std::lock_guard<std::mutex> lock(client->mutex);
+		client->sent += client->sending.size();
+		client->sending.clear();
+		if (client->pending.empty() || (client->period > 0))
+			client->scheduled = false;
+		else
+			con->get_strand()->post(std::bind(&BasicWebSocketPublisher::flush, this, client));
+	}
+	
+	void deliver(typename server_type::connection_ptr con, Client& client, message_ptr msg)
+	{
+		TRACE_SCOPE("WebSocketPublisher::send");
+		client.bytes.fetch_add(msg->get_payload().size(), std::memory_order_relaxed);
+		bytes_.fetch_add(msg->get_payload().size(), std::memory_order_relaxed);
+		if (client.deflate && (msg->get_payload().size() > threshold_))
+		{
+			message_ptr compressed = con->get_message(msg->get_opcode(), msg->get_payload().size());
+			compressed->set_payload(msg->get_payload());
+			compressed->set_compressed(true);
+			con->send(compressed);
+		} else
+			con->send(msg);
+	}
+	
+	static uint64_t since(const std::string& resource)
+	{
+		std::size_t query = resource.find('?');
+		while (query != std::string::npos)
+		{
+			if (resource.compare(query + 1, 6, "since=") == 0)
+				return std::strtoull(resource.c_str() + query + 7, nullptr, 10);
+			query = resource.find('&', query + 1);
+		}
+		return 0;
+	}
+	
+	// A client that passes the last sequence it saw gets the deltas it missed if they are still in
+	// the history, every other client starts from a snapshot of the current state.
+	void open(websocketpp::connection_hdl hdl)
+	{
+		typename server_type::connection_ptr con = server_.get_con_from_hdl(hdl);
+		std::shared_ptr<Client> client = std::make_shared<Client>(hdl, con->get_subprotocol() == BINARY_PROTOCOL, con->get_response_header("Sec-WebSocket-Extensions").find("permessage-deflate") != std::string::npos);
+		uint64_t last = since(con->get_resource());
+		std::lock_guard<std::mutex> lock(mutex_);
+		if ((last > 0) && (last <= committed_) && (committed_ - last <= history_.size()))
+		{
+			std::lock_guard<std::mutex> clock(client->mutex);
+			for (std::size_t i = history_.size() - (committed_ - last); i < history_.size(); ++i)
+				coalesce(*client, history_[(historyHead_ + i) % history_.size()]);
+			spdlog::get("console")->debug("WebSocket client {} resumed after {} missed deltas.", con->get_remote_endpoint(), committed_ - last);
+			client->dropped = 0;
+			if (!client->pending.empty())
+			{
+				client->scheduled = true;
+				schedule(client);
+			}
+		} else if (client->binary)
+			deliverBinary(con, *client, state_, committed_, BINARY_SNAPSHOT);
+		else
+			deliver(con, *client, encodeSnapshot());
+		clients_[hdl] = client;
+	}
+	
+	void filter(std::shared_ptr<Client> client, std::shared_ptr<const SubscriptionFilter> filter)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::lock_guard<std::mutex> clock(client->mutex);
+		if (!client->filter)
+			for (const auto& it : state_)
+				client->visible.insert(it.first);
+		client->filter = filter;
+		for (const auto& it : state_)
+		{
+			bool match = !filter || filter->match(it.first, it.second.element);
+			if (match != (client->visible.count(it.first) > 0))
+				route(*client, it.second, match);
+		}
+		if (!filter)
+			client->visible.clear();
+		client->batch.reset();
+		if (!client->scheduled && !client->pending.empty())
+		{
+			client->scheduled = true;
+			schedule(client);
+		}
+	}
+	
+	// Rates are clamped between MIN_RATE and one update per wheel tick, so the period always fits.
+	void rate(std::shared_ptr<Client> client, double hz)
+	{
+		if (!std::isfinite(hz))
+			throw std::runtime_error("Rate must be a finite number of updates per second.");
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::lock_guard<std::mutex> clock(client->mutex);
+		client->period = (hz > 0) ? std::lround(1000 / (std::min(std::max(hz, MIN_RATE), 1000.0 / WHEEL_TICK) * WHEEL_TICK)) : 0;
+		if ((client->period > 0) && !client->wheeled)
+		{
+			client->wheeled = true;
+			++wheeled_;
+			wheel_[(cursor_ + client->period) % WHEEL_SLOTS].push_back(WheelEntry { client, (client->period - 1) / WHEEL_SLOTS });
+			if (!ticking_)
+			{
+				ticking_ = true;
+				server_.set_timer(WHEEL_TICK, std::bind(&BasicWebSocketPublisher::tick, this, std::placeholders::_1));
+			}
+		} else if ((client->period == 0) && !client->scheduled && !client->pending.empty())
+		{
+			client->scheduled = true;
+			schedule(client);
+		}
+	}
+	
+	// Rate-limited clients only accumulate updates, one shared wheel flushes each of them every period ticks.
+	void tick(websocketpp::lib::error_code ec)
+	{
+		if (ec)
+			return;
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::vector<WheelEntry> due;
+		due.swap(wheel_[cursor_]);
+		for (auto& entry : due)
+		{
+			std::shared_ptr<Client> client = entry.client.lock();
+			if (!client)
+			{
+				--wheeled_;
+				continue;
+			}
+			std::lock_guard<std::mutex> clock(client->mutex);
+			if (client->period == 0)
+			{
+				client->wheeled = false;
+				--wheeled_;
+			} else if (entry.rounds > 0)
+			{
+				--entry.rounds;
+				wheel_[cursor_].push_back(entry);
+			} else
+			{
+				if (!client->scheduled && !client->pending.empty())
+				{
+					client->scheduled = true;
+					schedule(client);
+				}
+				wheel_[(cursor_ + client->period) % WHEEL_SLOTS].push_back(WheelEntry { client, (client->period - 1) / WHEEL_SLOTS });
+			}
+		}
+		cursor_ = (cursor_ + 1) % WHEEL_SLOTS;
+		ticking_ = (wheeled_ > 0);
+		if (ticking_)
+			server_.set_timer(WHEEL_TICK, std::bind(&BasicWebSocketPublisher::tick, this, std::placeholders::_1));
+	}
+	
+	// Control messages: {"rate": hz} caps the updates per second (null or 0 lifts the cap), {"filter": ...} see SubscriptionFilter.
+	void message(websocketpp::connection_hdl hdl, message_ptr msg)
+	{
+		std::shared_ptr<Client> client;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			auto it = clients_.find(hdl);
+			if (it == clients_.end())
+				return;
+			client = it->second;
+		}
+		Json::Value control;
+		Json::Reader reader;
+		try
+		{
+			if (!reader.parse(msg->get_payload(), control) || !control.isObject())
+				throw std::runtime_error("Control messages must be JSON objects.");
+			if (control.isMember("rate"))
+			{
+				if (!control["rate"].isNull() && !control["rate"].isNumeric())
+					throw std::runtime_error("Rate must be a number of updates per second.");
+				rate(client, control["rate"].isNull() ? 0 : control["rate"].asDouble());
+			}
+			if (control.isMember("filter"))
+				filter(client, control["filter"].isNull() ? std::shared_ptr<const SubscriptionFilter>() : std::make_shared<const SubscriptionFilter>(control["filter"]));
+		} catch (const std::exception& e)
+		{
+			spdlog::get("console")->warn("Ignoring WebSocket control message: {}", e.what());
+		}
+	}
+	
+	void report(websocketpp::lib::error_code ec)
+	{
+		if (ec)
+			return;
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (const auto& it : clients_)
+		{
+			typename server_type::connection_ptr con = server_.get_con_from_hdl(it.first, ec);
+			if (!con)
+				continue;
+			std::lock_guard<std::mutex> clock(it.second->mutex);
+			spdlog::get("console")->debug("WebSocket client {}: {} queued, {} dropped, {} sent.", con->get_remote_endpoint(), it.second->pending.size(), it.second->dropped, it.second->sent);
+		}
+		server_.set_timer(STATS_PERIOD, std::bind(&BasicWebSocketPublisher::report, this, std::placeholders::_1));
+	}
+	
+	// Plain HTTP requests get the metrics of the whole process at /metrics, in the Prometheus text format.
+	void http(websocketpp::connection_hdl hdl)
+	{
+		typename server_type::connection_ptr con = server_.get_con_from_hdl(hdl);
+		std::string resource = con->get_resource();
+		if (resource.substr(0, resource.find('?')) != "/metrics")
+		{
+			con->set_status(websocketpp::http::status_code::not_found);
+			return;
+		}
+		con->append_header("Content-Type", "text/plain; version=0.0.4");
+		con->set_body(Metrics::exposition() + exposition());
+		con->set_status(websocketpp::http::status_code::ok);
+	}
+	
+	std::string exposition()
+	{
+		std::string out, queued, dropped, sent, bytes;
+		char buffer[160];
+		std::lock_guard<std::mutex> lock(mutex_);
+		out.append(buffer, std::snprintf(buffer, sizeof(buffer), "# TYPE sprits_elements gauge\nsprits_elements %zu\n", state_.size()));
+		out.append(buffer, std::snprintf(buffer, sizeof(buffer), "# TYPE sprits_websocket_clients gauge\nsprits_websocket_clients %zu\n", clients_.size()));
+		out.append(buffer, std::snprintf(buffer, sizeof(buffer), "# TYPE sprits_websocket_sent_bytes_total counter\nsprits_websocket_sent_bytes_total %llu\n", (unsigned long long) bytes_.load(std::memory_order_relaxed)));
+		for (const auto& it : clients_)
+		{
+			websocketpp::lib::error_code ec;
+			typename server_type::connection_ptr con = server_.get_con_from_hdl(it.first, ec);
+			if (!con)
+				continue;
+			std::string endpoint = con->get_remote_endpoint();
+			std::lock_guard<std::mutex> clock(it.second->mutex);
+			queued.append(buffer, std::snprintf(buffer, sizeof(buffer), "sprits_websocket_client_queued{client=\"%s\"} %zu\n", endpoint.c_str(), it.second->pending.size()));
+			dropped.append(buffer, std::snprintf(buffer, sizeof(buffer), "sprits_websocket_client_dropped_total{client=\"%s\"} %zu\n", endpoint.c_str(), it.second->dropped));
+			sent.append(buffer, std::snprintf(buffer, sizeof(buffer), "sprits_websocket_client_sent_total{client=\"%s\"} %zu\n", endpoint.c_str(), it.second->sent));
+			bytes.append(buffer, std::snprintf(buffer, sizeof(buffer), "sprits_websocket_client_sent_bytes_total{client=\"%s\"} %llu\n", endpoint.c_str(), (unsigned long long) it.second->bytes.load(std::memory_order_relaxed)));
+		}
+		out += "# TYPE sprits_websocket_client_queued gauge\n" + queued;
+		out += "# TYPE sprits_websocket_client_dropped_total counter\n" + dropped;
+		out += "# TYPE sprits_websocket_client_sent_total counter\n" + sent;
+		out += "# TYPE sprits_websocket_client_sent_bytes_total counter\n" + bytes;
+		return out;
+	}
+public:
+	BasicWebSocketPublisher(Space<std::tuple<double, double, double>>* spc, int port = 9002, std::size_t threads = 1, std::size_t threshold = DEFLATE_THRESHOLD) : SpaceObserver<std::tuple<double, double, double>>(spc), threshold_(threshold), wheel_(WHEEL_SLOTS), historyHead_(0), cursor_(0), wheeled_(0), ticking_(false), sequence_(BinaryWriter::now()), committed_(sequence_), bytes_(0) {
 		spdlog::get("console")->info("Starting WebSocket Server...");
+		// Sequences start at the wall clock in microseconds, so a client resuming across a restart always gets a snapshot.
+		history_.reserve(HISTORY_SIZE);
 		server_.clear_access_channels(websocketpp::log::alevel::all);
 		server_.init_asio();
 		server_.set_reuse_addr(true);
-		server_.set_open_handler(std::bind<void>([this](websocketpp::connection_hdl hdl){ std::lock_guard<std::mutex> lock(mutex_); connections_.insert(hdl); }, std::placeholders::_1));
-		server_.set_close_handler(std::bind<void>([this](websocketpp::connection_hdl hdl){ std::lock_guard<std::mutex> lock(mutex_); connections_.erase(hdl); }, std::placeholders::_1));
+		server_.set_validate_handler(std::bind<bool>([this](websocketpp::connection_hdl hdl){
+			typename server_type::connection_ptr con = server_.get_con_from_hdl(hdl);
+			for (auto const& protocol : con->get_requested_subprotocols())
+				if (protocol == BINARY_PROTOCOL)
+					con->select_subprotocol(protocol);
+			return true;
+		}, std::placeholders::_1));
+		server_.set_open_handler(std::bind(&BasicWebSocketPublisher::open, this, std::placeholders::_1));
+		server_.set_http_handler(std::bind(&BasicWebSocketPublisher::http, this, std::placeholders::_1));
+		server_.set_message_handler(std::bind(&BasicWebSocketPublisher::message, this, std::placeholders::_1, std::placeholders::_2));
+		server_.set_close_handler(std::bind<void>([this](websocketpp::connection_hdl hdl){ std::lock_guard<std::mutex> lock(mutex_); clients_.erase(hdl); }, std::placeholders::_1));
         server_.listen(port);
 		server_.start_accept();
-		thread_ = std::thread([this] { server_.run(); });
-		spdlog::get("console")->info("WebSocket Server started successfully!");
+		server_.set_timer(STATS_PERIOD, std::bind(&BasicWebSocketPublisher::report, this, std::placeholders::_1));
+		for (std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i)
+			threads_.push_back(std::thread([this] { server_.run(); }));
+		spdlog::get("console")->info("WebSocket Server started successfully with {} I/O threads!", threads_.size());
 	}
 	
-	~WebSocketPublisher()
+	~BasicWebSocketPublisher()
 	{
 		spdlog::get("console")->info("Stopping WebSocket Server...");
 		server_.stop();
-		thread_.join();
+		for (auto& thread : threads_)
+			thread.join();
 		spdlog::get("console")->info("WebSocket Server stopped successfully!");
 	}
 	
 	void fire(const ElementEvent& event, int id)
 	{
-		Json::Value message;
-		message["id"] = id;
-		message["op"] = event.get_state_as_string();
-		message["pos"] = Json::Value();
-		message["pos"].append(std::get<0>(spc_->getElement(id)));
-		message["pos"].append(std::get<1>(spc_->getElement(id)));
-		message["angle"] = std::get<2>(spc_->getElement(id));
-		
-        std::lock_guard<std::mutex> lock(mutex_);
-        for (auto it : connections_)
-            server_.send(it, Json::FastWriter().write(message), websocketpp::frame::opcode::text);
-
-        spdlog::get("console")->debug("WebSocket message {} sent.", Json::FastWriter().write(message));
+		frame_.push_back(Update { event.get_state(), id, spc_->getElement(id), BinaryWriter::now(), ++sequence_, message_ptr(), Metrics::trace().sensor });
+		SPDLOG_DEBUG(spdlog::get("console"), "WebSocket update {} of element {} queued.", event.get_state_as_string(), id);
+	}
+	
+	// Payloads are only encoded in the encodings connected clients use, once for all of them. Clients
+	// connecting meanwhile, resuming or routed through a filter get theirs encoded when flushed.
+	void commit()
+	{
+		if (frame_.empty())
+			return;
+		TRACE_SCOPE("WebSocketPublisher::commit");
+		bool json = false, binary = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			for (const auto& it : clients_)
+				(it.second->binary ? binary : json) = true;
+		}
+		if (json)
+			for (auto& update : frame_)
+				update.json = encodeJson(update);
+		// Frames too large for a single message are split per client by flush instead.
+		message_ptr batch;
+		if (binary && (frame_.size() <= BINARY_MAX_RECORDS))
+		{
+			auto it = frame_.cbegin();
+			batch = encodeBinary(it, frame_.size(), frame_.back().seq);
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			// Snapshots and resumes encode again, so only frame_ and the client queues pin pooled messages.
+			for (const auto& update : frame_)
+			{
+				if (update.op == REMOVE)
+					state_.erase(update.id);
+				else
+				{
+					Update& current = state_[update.id];
+					current = update;
+					current.op = ADD;
+					current.json.reset();
+				}
+				Update kept = update;
+				kept.json.reset();
+				if (history_.size() < HISTORY_SIZE)
+					history_.push_back(std::move(kept));
+				else
+				{
+					history_[historyHead_] = std::move(kept);
+					historyHead_ = (historyHead_ + 1) % HISTORY_SIZE;
+				}
+			}
+			committed_ = frame_.back().seq;
+			for (const auto& it : clients_)
+				enqueue(it.second, batch);
+		}
+		frame_.clear();
 	}
 };
 
+typedef BasicWebSocketPublisher<websocketpp::config::asio> WebSocketPublisher;
+typedef BasicWebSocketPublisher<DeflateConfig> DeflateWebSocketPublisher;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,164 @@
+#ifndef ASYNCSPACE_CC
+#define ASYNCSPACE_CC
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <spdlog/spdlog.h>
+#include <spdlog/details/mpmc_bounded_q.h>
+
+#include <Space.hpp>
+
+#define ASYNC_QUEUE_SIZE 65536 // Element events buffered between the trackers and the publishing thread, a power of two.
+
+using namespace SPRITS;
+
+// Moves the observers of a Space onto a publishing thread. Trackers only pay
+// for an enqueue per element change, while fire and commit of every
+// publisher run on the thread draining the queue. Positions travel with the
+// events, so getElement and the motion history answer with the state the
+// publishers were told about, and so does the frame trace, so publishing latencies still refer to the sensor.
+class AsyncSpace : public Space<std::tuple<double, double, double>>
+{
+private:
+	struct Event
+	{
+		ElementEvent_type type;
+		int id;
+		bool frame;
+		std::tuple<double, double, double> point;
+		MotionClock::time_point time;
+		FrameTrace trace;
+	};
+	Space<std::tuple<double, double, double>> *component_;
+	boost::signals2::connection con_, frameCon_;
+	spdlog::details::mpmc_bounded_queue<Event> queue_;
+	std::unordered_map<int, std::tuple<double, double, double>> elements_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::size_t frames_;
+	bool stop_;
+	std::atomic<bool> full_;
+	std::thread thread_;
+
+	void push(Event&& event)
+	{
+		Metrics::gauge(ASYNC_QUEUE).fetch_add(1, std::memory_order_relaxed);
+		if (queue_.enqueue(std::move(event)))
+			return;
+		// Warns once per overflow, the publishing thread rearms the warning whenever it empties the queue.
+		if (!full_.exchange(true, std::memory_order_relaxed))
+			spdlog::get("console")->warn("Publishing queue full, trackers wait for the publishers.");
+		// The publishing thread is woken up to make room, a frame larger than the queue never gets to its marker.
+		while (!queue_.enqueue(std::move(event)))
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				++frames_;
+			}
+			cv_.notify_one();
+			std::this_thread::yield();
+		}
+	}
+
+	void enqueue(const ElementEvent& event, int id)
+	{
+		MotionClock::time_point now = MotionClock::now();
+		push(Event { event.get_state(), id, false, (event.get_state() == REMOVE) ? std::tuple<double, double, double>() : component_->getElement(id), now, Metrics::trace() });
+	}
+
+	void enqueueFrame()
+	{
+		push(Event { UPDATE, 0, true, std::tuple<double, double, double>(), MotionClock::time_point(), Metrics::trace() });
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			++frames_;
+		}
+		cv_.notify_one();
+	}
+
+	void run()
+	{
+		Event event;
+		for (;;)
+		{
+			bool stopping, partial = false;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				cv_.wait(lock, [this] { return stop_ || (frames_ > 0); });
+				stopping = stop_;
+				frames_ = 0;
+			}
+			while (queue_.dequeue(event))
+			{
+				Metrics::gauge(ASYNC_QUEUE).fetch_sub(1, std::memory_order_relaxed);
+				Metrics::trace() = event.trace;
+				partial = !event.frame;
+				if (event.frame)
+				{
+					notifyFrame();
+					continue;
+				}
+				if (event.type == REMOVE)
+				{
+					elements_.erase(event.id);
+					forget(event.id);
+				} else
+				{
+					elements_[event.id] = event.point;
+					record(event.id, event.point, (event.trace.sequence > 0) ? event.trace.sensor : event.time);
+				}
+				notify(ElementEvent(event.type), event.id);
+			}
+			full_.store(false, std::memory_order_relaxed);
+			// Events left after the last frame, such as final removals, are committed as one more frame.
+			if (stopping)
+			{
+				if (partial)
+					notifyFrame();
+				return;
+			}
+		}
+	}
+public:
+	AsyncSpace(Space<std::tuple<double, double, double>> *component, std::size_t size = ASYNC_QUEUE_SIZE) : component_(component), con_(component->subscribe(boost::bind(&AsyncSpace::enqueue, this, _1, _2))), frameCon_(component->subscribeFrame(boost::bind(&AsyncSpace::enqueueFrame, this))), queue_(size), frames_(0), stop_(false), full_(false), thread_(&AsyncSpace::run, this) { }
+
+	~AsyncSpace()
+	{
+		con_.disconnect();
+		frameCon_.disconnect();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		cv_.notify_one();
+		thread_.join();
+		delete component_;
+	}
+
+	void setElement(int id)
+	{
+		component_->setElement(id);
+	}
+
+	void setElement(int id, std::tuple<double, double, double> point)
+	{
+		component_->setElement(id, point);
+	}
+
+	void commit()
+	{
+		component_->commit();
+	}
+
+	std::tuple<double, double, double> getElement(int id)
+	{
+		auto it = elements_.find(id);
+		return (it == elements_.end()) ? std::tuple<double, double, double>() : it->second;
+	}
+};
+
+#endif
@@ -1,41 +1,176 @@
 #ifndef PLANE_CC
 #define PLANE_CC
 
+#include <cmath>
+#include <mutex>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 #include <spdlog/spdlog.h>
 
+#include <Motion.hpp>
 #include <Space.hpp>
 
 using namespace SPRITS;
 
+#define MIN_CUTOFF 1.0 // One-Euro cutoff frequency (Hz) at rest. Lower values mean less jitter but more lag. 0 disables smoothing.
+#define BETA 10.0 // One-Euro speed coefficient. Higher values mean less lag during fast movements.
+#define DERIVATE_CUTOFF 1.0 // Cutoff frequency (Hz) used to smooth the speed estimate.
+
+// Trackers on the color and depth threads share a Plane, so every slot access holds mutex_.
+// Observers are notified after it is released, since they may block on a full AsyncSpace queue;
+// notifying_ keeps each thread's events together and in the order they were collected, and guards events_.
 class Plane : public Space<std::tuple<double, double, double>>
 {
 private:
-	std::map<int, std::tuple<double, double, double>> points_;
-	std::set<int> seen_;
+	typedef MotionTraits<std::tuple<double, double, double>> Traits;
+	enum SlotState : unsigned char { FREE, ADDED, UPDATED, CLEAN };
+	std::mutex mutex_;
+	std::mutex notifying_;
+	std::vector<std::pair<ElementEvent, int>> events_;
+	std::unordered_map<int, std::size_t> slots_;
+	std::vector<std::size_t> free_, pending_;
+	std::vector<int> ids_;
+	std::vector<SlotState> state_;
+	std::vector<MotionClock::time_point> time_;
+	std::vector<double> x_, y_, a_, fx_, fy_, fa_, dx_, dy_, da_, dt_, mask_;
+	double minCutoff_, beta_, dCutoff_;
+
+	static inline double alpha(double cutoff, double dt)
+	{
+		double r = 2 * M_PI * cutoff * dt;
+		return r / (r + 1);
+	}
+
+	std::size_t allocate(int id)
+	{
+		std::size_t slot;
+		if (free_.empty())
+		{
+			slot = ids_.size();
+			ids_.push_back(id);
+			state_.push_back(FREE);
+			time_.push_back(MotionClock::time_point());
+			for (auto v : { &x_, &y_, &a_, &fx_, &fy_, &fa_, &dx_, &dy_, &da_, &mask_ })
+				v->push_back(0);
+			dt_.push_back(1);
+		} else
+		{
+			slot = free_.back();
+			free_.pop_back();
+			ids_[slot] = id;
+		}
+		slots_[id] = slot;
+		return slot;
+	}
+
+	static void filter(std::size_t n, double minCutoff, double beta, double dCutoff, const double * __restrict x, const double * __restrict y, const double * __restrict a, const double * __restrict dt, const double * __restrict mask, double * __restrict fx, double * __restrict fy, double * __restrict fa, double * __restrict dx, double * __restrict dy, double * __restrict da)
+	{
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			double ex = x[i] - fx[i], ey = y[i] - fy[i], ea = Traits::wrap(a[i] - fa[i]);
+			double ad = mask[i] * alpha(dCutoff, dt[i]);
+			dx[i] += ad * (ex / dt[i] - dx[i]);
+			dy[i] += ad * (ey / dt[i] - dy[i]);
+			da[i] += ad * (ea / dt[i] - da[i]);
+			fx[i] += mask[i] * alpha(minCutoff + beta * std::fabs(dx[i]), dt[i]) * ex;
+			fy[i] += mask[i] * alpha(minCutoff + beta * std::fabs(dy[i]), dt[i]) * ey;
+			fa[i] = Traits::wrap(fa[i] + mask[i] * alpha(minCutoff + beta * std::fabs(da[i]), dt[i]) * ea);
+		}
+	}
 public:
+	Plane(double minCutoff = MIN_CUTOFF, double beta = BETA, double dCutoff = DERIVATE_CUTOFF) : minCutoff_(minCutoff), beta_(beta), dCutoff_(dCutoff) { }
+
 	void setElement(int id)
 	{
-		points_.erase(points_.find(id));
-		seen_.insert(id);
-		notify(ElementEvent(REMOVE), id);
+		std::lock_guard<std::mutex> notifying(notifying_);
+		std::unique_lock<std::mutex> lock(mutex_);
+		auto it = slots_.find(id);
+		if (it == slots_.end())
+			return;
+		std::size_t slot = it->second;
+		slots_.erase(it);
+		bool announced = (state_[slot] != ADDED);
+		state_[slot] = FREE;
+		mask_[slot] = 0;
+		free_.push_back(slot);
+		forget(id);
+		lock.unlock();
+		if (announced)
+			notify(ElementEvent(REMOVE), id);
 	}
+
 	void setElement(int id, std::tuple<double, double, double> point)
 	{
-		if (seen_.find(id) == seen_.end())
-			notify(ElementEvent(UPDATE), id);
-		else
+		MotionClock::time_point now = MotionClock::now();
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = slots_.find(id);
+		std::size_t slot = (it == slots_.end()) ? allocate(id) : it->second;
+		x_[slot] = std::get<0>(point);
+		y_[slot] = std::get<1>(point);
+		a_[slot] = std::get<2>(point);
+		switch (state_[slot])
+		{
+			case FREE:
+			case ADDED:
+			fx_[slot] = x_[slot];
+			fy_[slot] = y_[slot];
+			fa_[slot] = a_[slot];
+			dx_[slot] = dy_[slot] = da_[slot] = 0;
+			if (state_[slot] == FREE)
+				pending_.push_back(slot);
+			state_[slot] = ADDED;
+			break;
+			case CLEAN:
+			dt_[slot] = std::max(std::chrono::duration_cast<std::chrono::duration<double>>(now - time_[slot]).count(), 1e-6);
+			mask_[slot] = (minCutoff_ > 0) ? 1 : 0;
+			state_[slot] = UPDATED;
+			pending_.push_back(slot);
+			break;
+			case UPDATED:
+			dt_[slot] += std::chrono::duration_cast<std::chrono::duration<double>>(now - time_[slot]).count();
+			break;
+		}
+		if (minCutoff_ <= 0)
+		{
+			fx_[slot] = x_[slot];
+			fy_[slot] = y_[slot];
+			fa_[slot] = a_[slot];
+		}
+		time_[slot] = now;
+	}
+
+	void commit()
+	{
+		std::lock_guard<std::mutex> notifying(notifying_);
+		std::unique_lock<std::mutex> lock(mutex_);
+		filter(ids_.size(), minCutoff_, beta_, dCutoff_, x_.data(), y_.data(), a_.data(), dt_.data(), mask_.data(), fx_.data(), fy_.data(), fa_.data(), dx_.data(), dy_.data(), da_.data());
+		for (auto slot : pending_)
 		{
-			seen_.erase(seen_.find(id));
-			notify(ElementEvent(ADD), id);
+			if ((state_[slot] != ADDED) && (state_[slot] != UPDATED))
+				continue;
+			ElementEvent event((state_[slot] == ADDED) ? ADD : UPDATE);
+			state_[slot] = CLEAN;
+			mask_[slot] = 0;
+			record(ids_[slot], std::make_tuple(fx_[slot], fy_[slot], fa_[slot]), time_[slot]);
+			events_.emplace_back(event, ids_[slot]);
 		}
-		points_[id] = point;
+		pending_.clear();
+		lock.unlock();
+		for (const auto& it : events_)
+			notify(it.first, it.second);
+		events_.clear();
+		notifyFrame();
 	}
-	
+
 	std::tuple<double, double, double> getElement(int id)
 	{
-		return points_[id];
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = slots_.find(id);
+		if (it == slots_.end())
+			return std::tuple<double, double, double>();
+		return std::make_tuple(fx_[it->second], fy_[it->second], fa_[it->second]);
 	}
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,179 @@
+#ifndef PREDICTOR_CC
+#define PREDICTOR_CC
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <spdlog/spdlog.h>
+
+#include <Space.hpp>
+
+#define PROCESS_NOISE 50.0 // Spectral density of the white acceleration driving the constant-velocity model.
+#define MEASUREMENT_NOISE 1e-5 // Variance of a single tracker measurement.
+#define LATENCY_GAIN 0.05 // Weight of the newest frame in the running sensor to send latency estimate.
+
+using namespace SPRITS;
+
+struct KalmanAxis
+{
+	double p, v, P00, P01, P11;
+	bool angular;
+	KalmanAxis(bool angular = false) : p(0), v(0), P00(1), P01(0), P11(1), angular(angular) { }
+	double residual(double z)
+	{
+		return angular ? std::remainder(z - p, 2 * M_PI) : z - p;
+	}
+	void reset(double z)
+	{
+		p = z;
+		v = 0;
+		P00 = MEASUREMENT_NOISE;
+		P01 = 0;
+		P11 = 1;
+	}
+	void update(double z, double dt)
+	{
+		p += v * dt;
+		P00 += dt * (2 * P01 + dt * P11) + PROCESS_NOISE * dt * dt * dt / 3;
+		P01 += dt * P11 + PROCESS_NOISE * dt * dt / 2;
+		P11 += PROCESS_NOISE * dt;
+		double y = residual(z), S = P00 + MEASUREMENT_NOISE;
+		double K0 = P00 / S, K1 = P01 / S;
+		p += K0 * y;
+		v += K1 * y;
+		P11 -= K1 * P01;
+		P01 -= K1 * P00;
+		P00 -= K0 * P00;
+		if (angular)
+			p = std::remainder(p, 2 * M_PI);
+	}
+	double predict(double dt) const
+	{
+		return angular ? std::remainder(p + v * dt, 2 * M_PI) : p + v * dt;
+	}
+};
+
+class Predictor : public Space<std::tuple<double, double, double>>
+{
+private:
+	struct State
+	{
+		KalmanAxis x, y, angle;
+		MotionClock::time_point time;
+		State() : x(), y(), angle(true) { }
+	};
+	Space<std::tuple<double, double, double>> *component_;
+	boost::signals2::connection con_, frameCon_;
+	std::mutex mutex_;
+	std::unordered_map<int, State> states_;
+	uint64_t counts_[STAGES], sums_[STAGES];
+	double offset_, latency_;
+
+	// Measurements are taken at the sensor time of the frame being tracked, not when trackers get to them.
+	static MotionClock::time_point sensor()
+	{
+		const FrameTrace& trace = Metrics::trace();
+		return (trace.sequence > 0) ? trace.sensor : MotionClock::now();
+	}
+
+	// Folds the mean latency of the frames sent, or else published, since the last call into the estimate.
+	void measure()
+	{
+		double latest = -1;
+		for (Stage stage : { PUBLISH, SEND })
+		{
+			const LatencyHistogram& histogram = Metrics::stage(stage);
+			uint64_t count = histogram.count(), sum = histogram.sum();
+			if (count > counts_[stage])
+				latest = (sum - sums_[stage]) / 1e6 / (count - counts_[stage]);
+			counts_[stage] = count;
+			sums_[stage] = sum;
+		}
+		if (latest >= 0)
+			latency_ += LATENCY_GAIN * (latest - latency_);
+	}
+public:
+	Predictor(Space<std::tuple<double, double, double>> *component, double offset = 0) : component_(component), con_(component->subscribe(boost::bind(&Predictor::notify, this, _1, _2))), frameCon_(component->subscribeFrame(boost::bind(&Predictor::notifyFrame, this))), counts_(), sums_(), offset_(offset), latency_(0) { }
+
+	~Predictor()
+	{
+		con_.disconnect();
+		frameCon_.disconnect();
+		delete component_;
+	}
+
+	double getLatency() const
+	{
+		return offset_ + latency_;
+	}
+
+	// Trackers on different threads may share the Predictor, states and estimate are only touched under mutex_.
+	void setElement(int id)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			states_.erase(id);
+		}
+		component_->setElement(id);
+	}
+
+	void setElement(int id, std::tuple<double, double, double> point)
+	{
+		MotionClock::time_point time = sensor();
+		std::tuple<double, double, double> predicted;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			auto it = states_.find(id);
+			if (it == states_.end())
+			{
+				it = states_.emplace(id, State()).first;
+				it->second.x.reset(std::get<0>(point));
+				it->second.y.reset(std::get<1>(point));
+				it->second.angle.reset(std::get<2>(point));
+			} else
+			{
+				double dt = std::max(std::chrono::duration_cast<std::chrono::duration<double>>(time - it->second.time).count(), 0.0);
+				it->second.x.update(std::get<0>(point), dt);
+				it->second.y.update(std::get<1>(point), dt);
+				it->second.angle.update(std::get<2>(point), dt);
+			}
+			it->second.time = time;
+
+			double horizon = getLatency();
+			predicted = std::make_tuple(it->second.x.predict(horizon), it->second.y.predict(horizon), it->second.angle.predict(horizon));
+		}
+		component_->setElement(id, predicted);
+	}
+
+	void commit()
+	{
+		component_->commit();
+		std::lock_guard<std::mutex> lock(mutex_);
+		measure();
+	}
+
+	std::tuple<double, double, double> getElement(int id)
+	{
+		return component_->getElement(id);
+	}
+
+	void recordHistory()
+	{
+		component_->recordHistory();
+	}
+
+	bool getMotion(int id, MotionSample<std::tuple<double, double, double>>& sample)
+	{
+		return component_->getMotion(id, sample);
+	}
+
+	std::tuple<double, double, double> getElementAt(int id, MotionClock::time_point time)
+	{
+		return component_->getElementAt(id, time);
+	}
+};
+
+#endif
@@ -10,7 +10,7 @@
 #define HAS_MULTITHREADING
 
 #define PERSISTENCE 8 // The number of frames in which a tag should be absent before being removed from the output of find(). 0 means that tags disappear directly if they are not detected.
-#define GAIN 0.3f // A value between 0 and 1 corresponding to the weight of the previous (filtered) position in the new filtered position. 0 means that the latest position of the tag is returned.
+#define GAIN 0.0f // A value between 0 and 1 corresponding to the weight of the previous (filtered) position in the new filtered position. 0 means that the latest position of the tag is returned, smoothing is left to the Space.
 
 using namespace SPRITS;
 
@@ -28,6 +28,7 @@ public:
 	{
 		if (event == NewFrameEvent::COLOR)
 		{
+			TRACE_SCOPE("ChiliTracker::fire");
 			auto tags = trackedChilitags.find(frame, chilitags::Chilitags::ASYNC_DETECT_PERIODICALLY);
 			std::set<int> tracked, notfound, newfound;
 			for (const auto & tag : tags)
@@ -44,6 +45,7 @@ public:
 				alive.erase(id);
 				spc_->setElement(id);
 			}
+			spc_->commit();
 		}
 	}
 };
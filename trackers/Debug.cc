@@ -30,7 +30,7 @@ template<typename T> class Debug : public CameraObserver<T>
 {
 private:
 	std::map<NewFrameEvent, FPSCounter> counters_;
-	std::map<NewFrameEvent, clock_t> start_;
+	std::map<NewFrameEvent, MotionClock::time_point> start_;
 	bool record;
 	cv::VideoWriter out;
 public:
@@ -50,13 +50,16 @@ public:
 	
 	void fire(const NewFrameEvent& event, const cv::Mat& frame)
 	{
+		TRACE_SCOPE("Debug::fire");
+		MotionClock::time_point end = MotionClock::now();
 		if (start_.find(event) == start_.end())
-			start_[event] = clock();
+			start_[event] = end;
 		counters_[event].tick();
-		clock_t end = clock();
-		if ((end - start_[event])/(double)CLOCKS_PER_SEC > TIMEOUT)
+		if (end - start_[event] > std::chrono::seconds(TIMEOUT))
 		{
 			spdlog::get("console")->info("{} sensor recording at {} FPS.", (event==NewFrameEvent::COLOR?"Color":"Depth"), counters_[event].getFPS());
+			if (event == NewFrameEvent::COLOR)
+				spdlog::get("console")->info("Latency p50/p99 (ms): {}.", Metrics::summary());
 			start_[event] = end;
 		}
 
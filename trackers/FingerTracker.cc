@@ -1,9 +1,16 @@
 #include <Camera.hpp>
 #include <Space.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
 #include <feature_extractor.h>
 #include <spdlog/spdlog.h>
 
+#define FINGER_GATE 40 // Farthest a fingertip moves between two depth frames, in pixels, and keeps its id.
+
 using namespace SPRITS;
 
 class FingerTracker : public CameraObserverDecorator<std::tuple<double, double, double>>
@@ -11,6 +18,7 @@ class FingerTracker : public CameraObserverDecorator<std::tuple<double, double,
     FeatureExtractor *feature_extractor;
 	uint16_t t_gamma[2048];
 	uint8_t *depth_mid;
+	std::map<int, cv::Point2d> alive;
 public:
 	FingerTracker(CameraObserver<std::tuple<double, double, double>>* component) : CameraObserverDecorator<std::tuple<double, double, double>>(component, NewFrameEvent::DEPTH)
 	{
@@ -28,6 +36,7 @@ public:
 	{
 		if (event == NewFrameEvent::DEPTH)
 		{
+			TRACE_SCOPE("FingerTracker::fire");
 			int minDist = 255 * 5;
 			int* pixelDist = new int[307200];
 			
@@ -46,9 +55,53 @@ public:
 			}
 			
 			depth_mid = (uint8_t*)frame.data;
-			feature_extractor->Process(depth_mid, pixelDist, minDist);
+			{
+				TRACE_SCOPE("FeatureExtractor::Process");
+				feature_extractor->Process(depth_mid, pixelDist, minDist);
+			}
 			
-			spdlog::get("console")->debug("{} total fingers detected.", feature_extractor->GetNumFingerTips());
+			SPDLOG_DEBUG(spdlog::get("console"), "{} total fingers detected.", feature_extractor->GetNumFingerTips());
+			
+			// Detections come in no particular order, each one takes the id of the nearest fingertip of the
+			// previous frame within the gate, closest pairs first, and the others the lowest unused ids.
+			FeatureExtractor::VectorSegment *fingers = feature_extractor->GetFingerVectors();
+			std::vector<cv::Point2d> tips;
+			for (int i = 0; i < feature_extractor->GetNumFingerTips(); ++i)
+				tips.push_back(cv::Point2d(fingers[i].end % 640, fingers[i].end / 640));
+			std::vector<std::tuple<double, std::size_t, int>> pairs;
+			for (std::size_t i = 0; i < tips.size(); ++i)
+				for (const auto & tip : alive)
+				{
+					double distance = cv::norm(tips[i] - tip.second);
+					if (distance <= FINGER_GATE)
+						pairs.push_back(std::make_tuple(distance, i, tip.first));
+				}
+			std::sort(pairs.begin(), pairs.end());
+			std::vector<int> ids(tips.size(), -1);
+			std::map<int, cv::Point2d> tracked;
+			for (const auto & pair : pairs)
+				if ((ids[std::get<1>(pair)] < 0) && (tracked.find(std::get<2>(pair)) == tracked.end()))
+				{
+					ids[std::get<1>(pair)] = std::get<2>(pair);
+					tracked[std::get<2>(pair)] = tips[std::get<1>(pair)];
+				}
+			int next = FINGER_ID_OFFSET;
+			for (std::size_t i = 0; i < tips.size(); ++i)
+			{
+				if (ids[i] < 0)
+				{
+					while ((alive.find(next) != alive.end()) || (tracked.find(next) != tracked.end()))
+						++next;
+					ids[i] = next;
+					tracked[next] = tips[i];
+				}
+				spc_->setElement(ids[i], std::make_tuple<double, double, double>(tips[i].x / 640, tips[i].y / 480, std::atan2(tips[i].y - fingers[i].start / 640, tips[i].x - fingers[i].start % 640)));
+			}
+			for (const auto & tip : alive)
+				if (tracked.find(tip.first) == tracked.end())
+					spc_->setElement(tip.first);
+			alive.swap(tracked);
+			spc_->commit();
 		}
 	}
 };
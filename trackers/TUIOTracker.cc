@@ -0,0 +1,220 @@
+#include <Camera.hpp>
+#include <Space.hpp>
+
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include <spdlog/spdlog.h>
+
+#include <TUIO/TuioClient.h>
+#include <TUIO/TuioListener.h>
+#include <TUIO/TcpReceiver.h>
+#include <TUIO/UdpReceiver.h>
+
+#define TUIO_SOURCES "udp:3334" // Default ingested streams, see TUIOTracker::Source.
+
+using namespace SPRITS;
+
+// Feeds the objects of other TUIO servers, typically other SPRITS nodes covering part of a larger
+// surface, into the local Space. Each source maps its plane into the local one with an affine
+// transform, and a symbol id reported by several sources is merged into a single element at the
+// mean of their positions, published as REMOTE_ID_OFFSET plus the symbol id so local trackers never
+// overwrite or remove it. Changes collected by the receiver threads are applied on the camera
+// thread just before the decorated tracker runs, so they are committed with its frame. Elements
+// removed from the Space by anyone else are restored on the next frame.
+class TUIOTracker : public CameraObserverDecorator<std::tuple<double, double, double>>
+{
+private:
+	typedef std::tuple<double, double, double> Pose;
+
+	// Sources are given as udp:<port>, tcp:<port> (listening) or tcp:<host>:<port> (connecting),
+	// optionally followed by @a,b,c,d,e,f mapping (x, y) to (a x + b y + c, d x + e y + f).
+	struct Source : public TUIO::TuioListener
+	{
+		TUIOTracker* tracker;
+		std::string spec;
+		double a, b, c, d, e, f;
+		TUIO::OscReceiver* receiver;
+		TUIO::TuioClient* client;
+		std::unordered_map<long, std::pair<int, Pose>> objects;
+
+		Source(TUIOTracker* tracker, const std::string& source) : tracker(tracker), a(1), b(0), c(0), d(0), e(1), f(0)
+		{
+			std::size_t at = source.find('@');
+			spec = source.substr(0, at);
+			if (at != std::string::npos)
+			{
+				std::istringstream matrix(source.substr(at + 1));
+				std::vector<double> m;
+				for (std::string value; std::getline(matrix, value, ',');)
+					m.push_back(boost::lexical_cast<double>(value));
+				if (m.size() != 6)
+					throw std::runtime_error("Invalid TUIO source transform " + source + ".");
+				a = m[0]; b = m[1]; c = m[2]; d = m[3]; e = m[4]; f = m[5];
+			}
+			std::size_t first = spec.find(':'), last = spec.rfind(':');
+			if (first == std::string::npos)
+				throw std::runtime_error("Invalid TUIO source " + source + ".");
+			std::string protocol = spec.substr(0, first), host = (first == last) ? "" : spec.substr(first + 1, last - first - 1);
+			int port = boost::lexical_cast<int>(spec.substr(last + 1));
+			if ((protocol == "udp") && host.empty())
+				receiver = new TUIO::UdpReceiver(port);
+			else if (protocol == "tcp")
+				receiver = host.empty() ? new TUIO::TcpReceiver(port) : new TUIO::TcpReceiver(host.c_str(), port);
+			else
+				throw std::runtime_error("Invalid TUIO source " + source + ".");
+			client = new TUIO::TuioClient(receiver);
+			client->addTuioListener(this);
+			client->connect(false);
+		}
+
+		~Source()
+		{
+			client->disconnect();
+			delete client;
+			delete receiver;
+		}
+
+		Pose transform(TUIO::TuioObject* tobj) const
+		{
+			double x = tobj->getX(), y = tobj->getY();
+			return std::make_tuple(a * x + b * y + c, d * x + e * y + f, std::remainder(tobj->getAngle() + std::atan2(d, a), 2 * M_PI));
+		}
+
+		void addTuioObject(TUIO::TuioObject* tobj)
+		{
+			std::lock_guard<std::mutex> lock(tracker->mutex_);
+			objects[tobj->getSessionID()] = std::make_pair(tobj->getSymbolID(), transform(tobj));
+		}
+
+		void updateTuioObject(TUIO::TuioObject* tobj)
+		{
+			addTuioObject(tobj);
+		}
+
+		void removeTuioObject(TUIO::TuioObject* tobj)
+		{
+			std::lock_guard<std::mutex> lock(tracker->mutex_);
+			objects.erase(tobj->getSessionID());
+		}
+
+		void addTuioCursor(TUIO::TuioCursor* tcur) { }
+
+		void updateTuioCursor(TUIO::TuioCursor* tcur) { }
+
+		void removeTuioCursor(TUIO::TuioCursor* tcur) { }
+
+		void addTuioBlob(TUIO::TuioBlob* tblb) { }
+
+		void updateTuioBlob(TUIO::TuioBlob* tblb) { }
+
+		void removeTuioBlob(TUIO::TuioBlob* tblb) { }
+
+		void refresh(TUIO::TuioTime ftime)
+		{
+			std::lock_guard<std::mutex> lock(tracker->mutex_);
+			tracker->dirty_ = true;
+		}
+	};
+
+	struct Sum
+	{
+		double x, y, cos, sin;
+		int count;
+		Sum() : x(0), y(0), cos(0), sin(0), count(0) { }
+	};
+
+	std::mutex mutex_;
+	std::vector<Source*> sources_;
+	std::map<int, Pose> applied_;
+	std::set<int> removed_;
+	boost::signals2::connection removals_;
+	bool dirty_;
+
+	void removed(const ElementEvent& event, int id)
+	{
+		if ((event.get_state() != REMOVE) || (id < REMOTE_ID_OFFSET))
+			return;
+		std::lock_guard<std::mutex> lock(mutex_);
+		removed_.insert(id);
+	}
+public:
+	TUIOTracker(CameraObserver<std::tuple<double, double, double>>* component, const std::string& specs = TUIO_SOURCES) : CameraObserverDecorator<std::tuple<double, double, double>>(component, NewFrameEvent::COLOR), dirty_(false)
+	{
+		spdlog::get("console")->info("Starting TUIO ingestion...");
+		std::istringstream list(specs);
+		for (std::string spec; std::getline(list, spec, ';');)
+			sources_.push_back(new Source(this, spec));
+		if (sources_.empty())
+			throw std::runtime_error("No TUIO source given.");
+		removals_ = spc_->subscribe(boost::bind(&TUIOTracker::removed, this, _1, _2));
+		spdlog::get("console")->info("TUIO ingestion started successfully from {}!", specs);
+	}
+
+	~TUIOTracker()
+	{
+		spdlog::get("console")->info("Stopping TUIO ingestion...");
+		removals_.disconnect();
+		for (auto source : sources_)
+			delete source;
+		spdlog::get("console")->info("TUIO ingestion stopped successfully!");
+	}
+
+	void fire(const NewFrameEvent& event, const cv::Mat& frame)
+	{
+		TRACE_SCOPE("TUIOTracker::fire");
+		std::map<int, Sum> sums;
+		std::set<int> removed;
+		bool dirty;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			removed.swap(removed_);
+			dirty = dirty_;
+			dirty_ = false;
+			if (dirty)
+				for (auto source : sources_)
+					for (const auto& object : source->objects)
+					{
+						Sum& sum = sums[REMOTE_ID_OFFSET + object.second.first];
+						sum.x += std::get<0>(object.second.second);
+						sum.y += std::get<1>(object.second.second);
+						sum.cos += std::cos(std::get<2>(object.second.second));
+						sum.sin += std::sin(std::get<2>(object.second.second));
+						++sum.count;
+					}
+		}
+		// Our own removals are notified too, but are no longer applied by then.
+		for (int id : removed)
+		{
+			auto it = applied_.find(id);
+			if (it != applied_.end())
+				spc_->setElement(id, it->second);
+		}
+		if (!dirty)
+			return;
+		for (auto it = applied_.begin(); it != applied_.end();)
+			if (sums.count(it->first) == 0)
+			{
+				spc_->setElement(it->first);
+				it = applied_.erase(it);
+			} else
+				++it;
+		for (const auto& sum : sums)
+		{
+			Pose pose = std::make_tuple(sum.second.x / sum.second.count, sum.second.y / sum.second.count, std::atan2(sum.second.sin, sum.second.cos));
+			auto it = applied_.find(sum.first);
+			if ((it != applied_.end()) && (it->second == pose))
+				continue;
+			applied_[sum.first] = pose;
+			spc_->setElement(sum.first, pose);
+		}
+	}
+};